@@ -1,12 +1,45 @@
+#include <algorithm>
+#include <atomic>
 #include <cctype>
 #include <chrono>
 #include <cmath>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <limits>
+#include <list>
 #include <memory>
+#include <mutex>
+#include <new>
 #include <numeric>
+#include <sstream>
+#include <queue>
+#include <random>
 #include <stack>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#endif
+
 template <typename T>
 std::ostream& operator<<(std::ostream& os, const std::vector<T>& v) {
   os << "[ ";
@@ -27,42 +60,788 @@ std::ostream& operator<<(std::ostream& os, const std::stack<T>& s) {
   return os;
 }
 
-template <typename T>
-class Heap {
+// Public Heap operations, as reported to instrumentation policies. kBuild is
+// construction from a vector.
+enum class HeapOp { kBuild, kPush, kPop, kUpdate };
+constexpr int kNumHeapOps = 4;
+
+const char* op_name(HeapOp op) {
+  static const char* const names[kNumHeapOps] = {"build", "push", "pop", "update"};
+  return names[static_cast<int>(op)];
+}
+
+// Instrumentation policy that does nothing. A policy receives a call for
+// every heap event it defines a hook for; these hooks are empty and inline,
+// so an uninstrumented Heap compiles to the same code as before.
+struct NoInstrument {
+  // The element in array slot `slot` (offset included) was read or written.
+  void on_access(std::size_t /*slot*/) {}
+  // An operation starts or ends. Events in between belong to it; reserve()
+  // and set_offset() happen outside any operation unless Push grows the heap.
+  void on_begin(HeapOp /*op*/) {}
+  void on_end(HeapOp /*op*/) {}
+  // Two elements were compared with operator<.
+  void on_compare() {}
+  // An element was moved or copied into an array slot.
+  void on_move() {}
+  // A sift moved its hole one level up or down.
+  void on_level() {}
+  // A new array of `bytes` bytes was allocated.
+  void on_alloc(std::size_t /*bytes*/) {}
+};
+
+// Instrumentation policy that counts the work done by each kind of
+// operation, to tie throughput to comparisons, moves, levels and allocations.
+class OpCounter : public NoInstrument {
+ public:
+  struct Counts {
+    std::uint64_t ops = 0;
+    std::uint64_t compares = 0;
+    std::uint64_t moves = 0;
+    std::uint64_t levels = 0;
+    std::uint64_t allocs = 0;
+    std::uint64_t alloc_bytes = 0;
+
+    Counts& operator+=(const Counts& other) {
+      ops += other.ops;
+      compares += other.compares;
+      moves += other.moves;
+      levels += other.levels;
+      allocs += other.allocs;
+      alloc_bytes += other.alloc_bytes;
+      return *this;
+    }
+  };
+
+  void on_begin(HeapOp op) {
+    current_ = &counts_[static_cast<int>(op)];
+    ++current_->ops;
+  }
+  void on_end(HeapOp) { current_ = &outside_; }
+  void on_compare() { ++current_->compares; }
+  void on_move() { ++current_->moves; }
+  void on_level() { ++current_->levels; }
+  void on_alloc(std::size_t bytes) {
+    ++current_->allocs;
+    current_->alloc_bytes += bytes;
+  }
+
+  const Counts& counts(HeapOp op) const { return counts_[static_cast<int>(op)]; }
+  // Work done outside any operation: reserve() and set_offset().
+  const Counts& outside() const { return outside_; }
+  // Work summed over all operations, excluding outside().
+  Counts total() const {
+    Counts sum;
+    for (const auto& c : counts_) sum += c;
+    return sum;
+  }
+  void Reset() { *this = OpCounter(); }
+
+  OpCounter() = default;
+  OpCounter(const OpCounter& other) { *this = other; }
+  // current_ points into this object, so copies must re-aim it.
+  OpCounter& operator=(const OpCounter& other) {
+    std::copy(other.counts_, other.counts_ + kNumHeapOps, counts_);
+    outside_ = other.outside_;
+    current_ = other.current_ == &other.outside_
+                   ? &outside_
+                   : counts_ + (other.current_ - other.counts_);
+    return *this;
+  }
+
+ private:
+  Counts counts_[kNumHeapOps];
+  Counts outside_;
+  Counts* current_ = &outside_;
+};
+
+// Log-bucketed latency histogram in the style of HdrHistogram: values below
+// 2^kSubBits nanoseconds get a bucket each, and every power of two above that
+// is split into 2^kSubBits linear buckets, so any recorded value is known to
+// within about 3%. Histograms merge by adding buckets.
+class LatencyHistogram {
+ public:
+  static constexpr int kSubBits = 5;
+  static constexpr std::size_t kSubBuckets = std::size_t{1} << kSubBits;
+  static constexpr std::size_t kNumBuckets = kSubBuckets * (64 - kSubBits + 1);
+
+  void Record(std::uint64_t ns) {
+    ++buckets_[bucket(ns)];
+    ++count_;
+    min_ = std::min(min_, ns);
+    max_ = std::max(max_, ns);
+  }
+
+  void Merge(const LatencyHistogram& other) {
+    for (std::size_t i = 0; i < kNumBuckets; ++i) buckets_[i] += other.buckets_[i];
+    count_ += other.count_;
+    min_ = std::min(min_, other.min_);
+    max_ = std::max(max_, other.max_);
+  }
+
+  void Reset() { *this = LatencyHistogram(); }
+
+  std::uint64_t count() const { return count_; }
+  std::uint64_t min() const { return count_ ? min_ : 0; }
+  std::uint64_t max() const { return max_; }
+
+  // Smallest value that p (in [0, 1]) of the recorded values don't exceed,
+  // rounded up to its bucket's upper bound (and capped at the maximum).
+  std::uint64_t Percentile(double p) const {
+    if (count_ == 0) return 0;
+    const auto rank = std::max<std::uint64_t>(
+        static_cast<std::uint64_t>(std::ceil(p * static_cast<double>(count_))), 1);
+    std::uint64_t seen = 0;
+    for (std::size_t i = 0; i < kNumBuckets; ++i) {
+      seen += buckets_[i];
+      if (seen >= rank) return std::min(bucket_high(i), max_);
+    }
+    return max_;
+  }
+
+  // Writes one "low_ns,high_ns,count" line per non-empty bucket.
+  void Export(std::ostream& os) const {
+    for (std::size_t i = 0; i < kNumBuckets; ++i) {
+      if (buckets_[i]) os << bucket_low(i) << ',' << bucket_high(i) << ',' << buckets_[i] << '\n';
+    }
+  }
+
+ private:
+  static std::size_t bucket(std::uint64_t ns) {
+    if (ns < kSubBuckets) return static_cast<std::size_t>(ns);
+    const int shift = 63 - __builtin_clzll(ns) - kSubBits;
+    return kSubBuckets * (shift + 1) + static_cast<std::size_t>((ns >> shift) - kSubBuckets);
+  }
+  static std::uint64_t bucket_low(std::size_t i) {
+    if (i < kSubBuckets) return i;
+    const std::size_t shift = i / kSubBuckets - 1;
+    return static_cast<std::uint64_t>(kSubBuckets + i % kSubBuckets) << shift;
+  }
+  static std::uint64_t bucket_high(std::size_t i) {
+    if (i < kSubBuckets) return i;
+    const std::size_t shift = i / kSubBuckets - 1;
+    return bucket_low(i) + (std::uint64_t{1} << shift) - 1;
+  }
+
+  std::uint64_t buckets_[kNumBuckets] = {};
+  std::uint64_t count_ = 0;
+  std::uint64_t min_ = std::numeric_limits<std::uint64_t>::max();
+  std::uint64_t max_ = 0;
+};
+
+constexpr int LatencyHistogram::kSubBits;
+constexpr std::size_t LatencyHistogram::kSubBuckets;
+constexpr std::size_t LatencyHistogram::kNumBuckets;
+
+// One latency histogram per kind of Heap operation.
+struct OpLatencies {
+  LatencyHistogram& operator[](HeapOp op) { return ops[static_cast<int>(op)]; }
+  const LatencyHistogram& operator[](HeapOp op) const { return ops[static_cast<int>(op)]; }
+
+  void Merge(const OpLatencies& other) {
+    for (int i = 0; i < kNumHeapOps; ++i) ops[i].Merge(other.ops[i]);
+  }
+  void Reset() {
+    for (auto& h : ops) h.Reset();
+  }
+
+  LatencyHistogram ops[kNumHeapOps];
+};
+
+// The calling thread's histograms. Each thread records into its own without
+// synchronization; merge them once the threads are done.
+OpLatencies& thread_latencies() {
+  thread_local OpLatencies latencies;
+  return latencies;
+}
+
+// Instrumentation policy that times every operation with steady_clock and
+// records it in thread_latencies().
+class LatencyRecorder : public NoInstrument {
+ public:
+  void on_begin(HeapOp) { start_ = std::chrono::steady_clock::now(); }
+  void on_end(HeapOp op) {
+    const auto elapsed = std::chrono::steady_clock::now() - start_;
+    thread_latencies()[op].Record(static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count()));
+  }
+
+ private:
+  std::chrono::steady_clock::time_point start_;
+};
+
+// Histogram of sift depths, one bucket per level. A binary heap indexed by
+// 64-bit positions is at most 64 levels deep.
+class DepthHistogram {
+ public:
+  static constexpr std::size_t kMaxDepth = 64;
+
+  void Record(std::size_t depth) {
+    ++buckets_[std::min(depth, kMaxDepth)];
+    ++count_;
+  }
+
+  void Merge(const DepthHistogram& other) {
+    for (std::size_t d = 0; d <= kMaxDepth; ++d) buckets_[d] += other.buckets_[d];
+    count_ += other.count_;
+  }
+
+  void Reset() { *this = DepthHistogram(); }
+
+  std::uint64_t count() const { return count_; }
+  std::uint64_t at(std::size_t depth) const { return buckets_[depth]; }
+
+  double mean() const {
+    if (count_ == 0) return 0;
+    double sum = 0;
+    for (std::size_t d = 0; d <= kMaxDepth; ++d) sum += static_cast<double>(d) * buckets_[d];
+    return sum / count_;
+  }
+
+  // Share of recorded sifts that moved at most depth levels.
+  double share_within(std::size_t depth) const {
+    if (count_ == 0) return 0;
+    std::uint64_t within = 0;
+    for (std::size_t d = 0; d <= std::min(depth, kMaxDepth); ++d) within += buckets_[d];
+    return static_cast<double>(within) / count_;
+  }
+
+  // Smallest depth that p (in [0, 1]) of the recorded sifts don't exceed.
+  std::size_t Percentile(double p) const {
+    const auto rank = std::max<std::uint64_t>(
+        static_cast<std::uint64_t>(std::ceil(p * static_cast<double>(count_))), 1);
+    std::uint64_t seen = 0;
+    for (std::size_t d = 0; d <= kMaxDepth; ++d) {
+      seen += buckets_[d];
+      if (seen >= rank) return d;
+    }
+    return 0;
+  }
+
+  // Writes one "depth,count" line per non-empty bucket.
+  void Export(std::ostream& os) const {
+    for (std::size_t d = 0; d <= kMaxDepth; ++d) {
+      if (buckets_[d]) os << d << ',' << buckets_[d] << '\n';
+    }
+  }
+
+ private:
+  std::uint64_t buckets_[kMaxDepth + 1] = {};
+  std::uint64_t count_ = 0;
+};
+
+constexpr std::size_t DepthHistogram::kMaxDepth;
+
+// Instrumentation policy that samples how many levels each operation's sift
+// moves: Push sifts up, Pop down, and Update either way. Shallow sift-ups
+// point to FIFO-like arrival orders, deep sifts to random ones. One
+// operation in every period() is sampled, so the cost of the others is a
+// countdown; builds, which sift from every parent, aren't recorded.
+class SiftDepthSampler : public NoInstrument {
+ public:
+  void on_begin(HeapOp op) {
+    if (op == HeapOp::kBuild || --countdown_ > 0) return;
+    countdown_ = period_;
+    sampling_ = true;
+    depth_ = 0;
+  }
+  void on_level() { depth_ += sampling_; }
+  void on_end(HeapOp op) {
+    if (!sampling_) return;
+    depths_[static_cast<int>(op)].Record(depth_);
+    sampling_ = false;
+  }
+
+  // Samples one operation in every period, from the next one on.
+  void set_period(std::uint32_t period) {
+    period_ = std::max<std::uint32_t>(period, 1);
+    countdown_ = 1;
+  }
+  std::uint32_t period() const { return period_; }
+
+  const DepthHistogram& depths(HeapOp op) const { return depths_[static_cast<int>(op)]; }
+
+  // Writes one "op,depth,count" line per non-empty bucket.
+  void Export(std::ostream& os) const {
+    for (int i = 0; i < kNumHeapOps; ++i) {
+      for (std::size_t d = 0; d <= DepthHistogram::kMaxDepth; ++d) {
+        if (depths_[i].at(d)) {
+          os << op_name(static_cast<HeapOp>(i)) << ',' << d << ',' << depths_[i].at(d) << '\n';
+        }
+      }
+    }
+  }
+
+  void Reset() {
+    for (auto& h : depths_) h.Reset();
+  }
+
+ private:
+  std::uint32_t period_ = 64;
+  std::uint32_t countdown_ = 1;
+  bool sampling_ = false;
+  std::size_t depth_ = 0;
+  DepthHistogram depths_[kNumHeapOps];
+};
+
+//
+// Shared-memory metrics
+//
+// A heap's counters published into a POSIX shared-memory object, for an
+// agent in another process to read while the heap runs. The hot path only
+// bumps counters in a MetricsRecorder; the heap's owner copies them out with
+// Publish() at its own cadence. A seqlock keeps readers from ever blocking
+// the writer: a reader whose copy overlapped a publish retries.
+
+constexpr std::uint64_t kMetricsMagic = 0x3154454d50414548;  // "HEAPMET1"
+constexpr int kMetricsLatencyBuckets = 32;  // bucket b: [2^b, 2^(b+1)) ns
+
+static_assert(ATOMIC_LLONG_LOCK_FREE == 2, "shared metrics need lock-free 64-bit atomics");
+
+// One publish's worth of metrics. All fields are 64-bit words, which is how
+// they travel through the shared page.
+struct MetricsSnapshot {
+  std::uint64_t size = 0;
+  std::uint64_t ops[kNumHeapOps] = {};  // operations since the heap was made
+  std::uint64_t rebuilds = 0;       // array reallocations other than a build's
+  std::uint64_t ops_per_sec = 0;    // over the interval since the previous publish
+  std::uint64_t published_ns = 0;   // steady_clock time of the publish
+  std::uint64_t publishes = 0;
+  std::uint64_t latency[kMetricsLatencyBuckets] = {};  // sampled operation latencies
+};
+
+static_assert(std::is_trivially_copyable<MetricsSnapshot>::value &&
+                  sizeof(MetricsSnapshot) % sizeof(std::uint64_t) == 0,
+              "MetricsSnapshot must be plain 64-bit words");
+
+// Layout of the shared page. Every word is a lock-free atomic, so a reader
+// racing a publish can see a torn copy but no undefined behavior, and the
+// sequence number tells it to retry.
+struct SharedMetrics {
+  static constexpr std::size_t kWords = sizeof(MetricsSnapshot) / sizeof(std::uint64_t);
+
+  std::atomic<std::uint64_t> magic;
+  std::atomic<std::uint64_t> seq;  // odd while a publish is in progress
+  std::atomic<std::uint64_t> words[kWords];
+};
+
+constexpr std::size_t SharedMetrics::kWords;
+
+// Maps the shared-memory object name (e.g. "/heap-metrics"), creating and
+// sizing it if create is set. Throws std::runtime_error.
+void* map_metrics(const std::string& name, bool create) {
+  const int fd = create ? shm_open(name.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644)
+                        : shm_open(name.c_str(), O_RDONLY, 0);
+  if (fd < 0) throw std::runtime_error("can't open shared memory " + name);
+  if (create && ftruncate(fd, sizeof(SharedMetrics)) != 0) {
+    close(fd);
+    shm_unlink(name.c_str());
+    throw std::runtime_error("can't size shared memory " + name);
+  }
+  struct stat st;
+  if (!create && (fstat(fd, &st) != 0 || st.st_size < static_cast<off_t>(sizeof(SharedMetrics)))) {
+    close(fd);
+    throw std::runtime_error(name + " is not a heap metrics page");
+  }
+  void* p = mmap(nullptr, sizeof(SharedMetrics), create ? PROT_READ | PROT_WRITE : PROT_READ,
+                 MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    if (create) shm_unlink(name.c_str());
+    throw std::runtime_error("can't map shared memory " + name);
+  }
+  return p;
+}
+
+// Writer side: owns the shared-memory object and unlinks it when destroyed.
+// One thread publishes at a time.
+class MetricsPage {
+ public:
+  explicit MetricsPage(const std::string& name)
+      : name_(name), page_(new (map_metrics(name, true)) SharedMetrics()) {
+    for (auto& w : page_->words) w.store(0, std::memory_order_relaxed);
+    page_->seq.store(0, std::memory_order_relaxed);
+    page_->magic.store(kMetricsMagic, std::memory_order_release);
+  }
+  ~MetricsPage() {
+    munmap(page_, sizeof(SharedMetrics));
+    shm_unlink(name_.c_str());
+  }
+  MetricsPage(const MetricsPage&) = delete;
+  MetricsPage& operator=(const MetricsPage&) = delete;
+
+  const std::string& name() const { return name_; }
+
+  void Publish(const MetricsSnapshot& snapshot) {
+    std::uint64_t words[SharedMetrics::kWords];
+    std::memcpy(words, &snapshot, sizeof(words));
+    const std::uint64_t seq = page_->seq.load(std::memory_order_relaxed);
+    page_->seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    for (std::size_t i = 0; i < SharedMetrics::kWords; ++i) {
+      page_->words[i].store(words[i], std::memory_order_relaxed);
+    }
+    page_->seq.store(seq + 2, std::memory_order_release);
+  }
+
+ private:
+  std::string name_;
+  SharedMetrics* page_;
+};
+
+// Reader side, for another process. Throws std::runtime_error if name isn't
+// a metrics page.
+class MetricsReader {
+ public:
+  explicit MetricsReader(const std::string& name)
+      : page_(static_cast<const SharedMetrics*>(map_metrics(name, false))) {
+    if (page_->magic.load(std::memory_order_acquire) != kMetricsMagic) {
+      munmap(const_cast<SharedMetrics*>(page_), sizeof(SharedMetrics));
+      throw std::runtime_error(name + " is not a heap metrics page");
+    }
+  }
+  ~MetricsReader() { munmap(const_cast<SharedMetrics*>(page_), sizeof(SharedMetrics)); }
+  MetricsReader(const MetricsReader&) = delete;
+  MetricsReader& operator=(const MetricsReader&) = delete;
+
+  // A consistent copy of the latest publish.
+  MetricsSnapshot Read() const {
+    std::uint64_t words[SharedMetrics::kWords];
+    while (true) {
+      const std::uint64_t seq = page_->seq.load(std::memory_order_acquire);
+      if (seq & 1) {
+        std::this_thread::yield();
+        continue;
+      }
+      for (std::size_t i = 0; i < SharedMetrics::kWords; ++i) {
+        words[i] = page_->words[i].load(std::memory_order_relaxed);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (page_->seq.load(std::memory_order_relaxed) == seq) break;
+    }
+    MetricsSnapshot snapshot;
+    std::memcpy(&snapshot, words, sizeof(words));
+    return snapshot;
+  }
+
+ private:
+  const SharedMetrics* page_;
+};
+
+// Instrumentation policy feeding a MetricsPage. Each operation bumps a
+// counter; one in kMetricsLatencyPeriod is also timed. Nothing is shared
+// until the owner calls Publish(), so the hot path never touches the page.
+class MetricsRecorder : public NoInstrument {
+ public:
+  static constexpr std::uint32_t kMetricsLatencyPeriod = 64;
+
+  void on_begin(HeapOp op) {
+    in_build_ = op == HeapOp::kBuild;
+    ++snapshot_.ops[static_cast<int>(op)];
+    if (--countdown_ == 0) {
+      countdown_ = kMetricsLatencyPeriod;
+      timing_ = true;
+      start_ = std::chrono::steady_clock::now();
+    }
+  }
+  void on_end(HeapOp) {
+    in_build_ = false;
+    if (!timing_) return;
+    timing_ = false;
+    const auto ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                             start_).count());
+    ++snapshot_.latency[ns == 0 ? 0
+                                : std::min(63 - __builtin_clzll(ns), kMetricsLatencyBuckets - 1)];
+  }
+  // reserve(), set_offset() and a Push that grows the array all reallocate.
+  void on_alloc(std::size_t) {
+    if (!in_build_) ++snapshot_.rebuilds;
+  }
+
+  // Publishes the counters, with the heap's current size, to page.
+  void Publish(MetricsPage& page, std::size_t size) {
+    const auto now = std::chrono::steady_clock::now();
+    std::uint64_t ops = 0;
+    for (const auto n : snapshot_.ops) ops += n;
+    const double seconds = std::chrono::duration<double>(now - last_publish_).count();
+    snapshot_.ops_per_sec =
+        seconds > 0 ? static_cast<std::uint64_t>((ops - last_ops_) / seconds) : 0;
+    snapshot_.size = size;
+    snapshot_.published_ns = static_cast<std::uint64_t>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch()).count());
+    ++snapshot_.publishes;
+    page.Publish(snapshot_);
+    last_publish_ = now;
+    last_ops_ = ops;
+  }
+
+  const MetricsSnapshot& snapshot() const { return snapshot_; }
+
+ private:
+  MetricsSnapshot snapshot_;
+  bool in_build_ = false;
+  bool timing_ = false;
+  std::uint32_t countdown_ = 1;
+  std::chrono::steady_clock::time_point start_;
+  std::chrono::steady_clock::time_point last_publish_ = std::chrono::steady_clock::now();
+  std::uint64_t last_ops_ = 0;
+};
+
+constexpr std::uint32_t MetricsRecorder::kMetricsLatencyPeriod;
+
+constexpr std::size_t kCacheLineSize = 64;
+
+// Memory layout of a heap as it actually sits in memory, for checking that a
+// deployed heap got the alignment and offset it was configured for.
+struct HeapStats {
+  std::size_t size = 0;           // elements
+  std::size_t capacity = 0;       // elements that fit without reallocating
+  std::size_t element_bytes = 0;  // sizeof(T)
+  std::size_t bytes = 0;          // allocated, offset and alignment padding included
+  std::size_t alignment = 0;      // largest power of two dividing the array address
+  std::size_t offset = 0;         // root slot, in elements
+  std::size_t offset_bytes = 0;   // root slot, in bytes from the array start
+  std::size_t depth = 0;          // levels in the tree
+  std::size_t line = 0;           // cache line size the groups were checked against
+  std::size_t sibling_groups = 0;     // children sharing a parent
+  std::size_t straddling_groups = 0;  // ... that span two cache lines
+};
+
+// Fills a HeapStats for a binary heap whose array of element_bytes-sized
+// slots starts at base, with the root offset slots in. Counting straddling
+// sibling groups visits every parent, O(size).
+HeapStats heap_stats(const void* base, std::size_t element_bytes, std::size_t size,
+                     std::size_t capacity, std::size_t offset, std::size_t bytes,
+                     std::size_t line) {
+  HeapStats s;
+  s.size = size;
+  s.capacity = capacity;
+  s.element_bytes = element_bytes;
+  s.bytes = bytes;
+  const auto address = reinterpret_cast<std::uintptr_t>(base);
+  s.alignment = static_cast<std::size_t>(address & (~address + 1));
+  s.offset = offset;
+  s.offset_bytes = offset * element_bytes;
+  for (std::size_t n = size; n > 0; n /= 2) ++s.depth;
+  s.line = line;
+  const std::uintptr_t root = address + s.offset_bytes;
+  for (std::size_t parent = 0; parent < size / 2; ++parent) {
+    const std::size_t first = 2 * parent + 1;
+    const std::size_t end = std::min(first + 2, size);
+    ++s.sibling_groups;
+    if ((root + first * element_bytes) / line != (root + end * element_bytes - 1) / line) {
+      ++s.straddling_groups;
+    }
+  }
+  return s;
+}
+
+// Parameters of the analytic layout model: an arity-ary heap of
+// element_bytes-sized slots in an array at address base, root offset slots
+// in. Only base modulo line and page matters, so a base of 16 models an
+// array malloc aligned to exactly 16 bytes.
+struct LayoutModel {
+  std::size_t element_bytes = 4;
+  std::size_t arity = 2;
+  std::size_t offset = 0;
+  std::size_t base = 16;
+  std::size_t line = kCacheLineSize;
+  std::size_t page = 4096;
+};
+
+// Distinct lines and pages a heap of n elements touches, from LayoutModel
+// alone. A path is a sift-down from the root to the bottom that reads every
+// child group on the way, each child equally likely (exact for a full tree);
+// a build touches every line and page the elements span.
+struct LayoutPrediction {
+  std::size_t depth = 0;
+  double path_lines = 0;
+  double path_pages = 0;
+  std::size_t build_lines = 0;
+  std::size_t build_pages = 0;
+};
+
+// First and last block of block_size bytes spanned by slots [first, last].
+std::pair<std::size_t, std::size_t> model_blocks(const LayoutModel& m, std::size_t block_size,
+                                                  std::size_t first, std::size_t last) {
+  const std::size_t begin = m.base + (m.offset + first) * m.element_bytes;
+  const std::size_t end = m.base + (m.offset + last + 1) * m.element_bytes;
+  return {begin / block_size, (end - 1) / block_size};
+}
+
+// Expected blocks of block_size bytes a path touches. Near the root a child
+// group can share blocks with groups above it, so those levels walk the
+// path's ancestors; from the parent index where a group starts a whole block
+// past anything above it, only each group's own span counts. Every parent is
+// visited either way: exact, and O(n).
+double model_path_blocks(const LayoutModel& m, std::size_t n, std::size_t block_size) {
+  if (n == 0) return 0;
+  const std::size_t a = m.arity;
+  auto span = [&](std::size_t first, std::size_t last) {
+    const auto b = model_blocks(m, block_size, first, last);
+    return static_cast<double>(b.second - b.first + 1);
+  };
+  const std::size_t disjoint_from = block_size / ((a - 1) * m.element_bytes) + 2;
+  const std::size_t parents = (n - 2) / a + 1;  // positions with a child, n > 1
+  double total = span(0, 0);
+  std::vector<std::pair<std::size_t, std::size_t>> above;
+  for (std::size_t level_begin = 0, width = 1; n > 1 && level_begin < parents;
+       level_begin = level_begin * a + 1, width *= a) {
+    const std::size_t level_end = std::min(level_begin + width, parents);
+    double level = 0;
+    for (std::size_t i = level_begin; i < level_end; ++i) {
+      const std::size_t first = a * i + 1, last = std::min(a * i + a, n - 1);
+      if (i < disjoint_from) {
+        // Blocks of the root and of each group on the way down to i.
+        above.assign(1, model_blocks(m, block_size, 0, 0));
+        for (std::size_t j = i; j > 0; j = (j - 1) / a) {
+          const std::size_t p = (j - 1) / a;
+          above.push_back(model_blocks(m, block_size, a * p + 1, std::min(a * p + a, n - 1)));
+        }
+        const auto b = model_blocks(m, block_size, first, last);
+        for (std::size_t block = b.first; block <= b.second; ++block) {
+          const bool seen = std::any_of(above.begin(), above.end(), [&](const auto& r) {
+            return r.first <= block && block <= r.second;
+          });
+          if (!seen) level += 1;
+        }
+      } else {
+        level += span(first, last);
+      }
+    }
+    total += level / (level_end - level_begin);
+  }
+  return total;
+}
+
+// Evaluates the layout model for a heap of n elements. Throws
+// std::invalid_argument on an arity below 2 or a zero size in m.
+LayoutPrediction predict_layout(const LayoutModel& m, std::size_t n) {
+  if (m.arity < 2 || m.element_bytes == 0 || m.line == 0 || m.page == 0) {
+    throw std::invalid_argument("layout model needs arity >= 2 and nonzero sizes");
+  }
+  LayoutPrediction p;
+  for (std::size_t first = 0; first < n; first = first * m.arity + 1) ++p.depth;
+  p.path_lines = model_path_blocks(m, n, m.line);
+  p.path_pages = model_path_blocks(m, n, m.page);
+  if (n > 0) {
+    const auto lines = model_blocks(m, m.line, 0, n - 1);
+    const auto pages = model_blocks(m, m.page, 0, n - 1);
+    p.build_lines = lines.second - lines.first + 1;
+    p.build_pages = pages.second - pages.first + 1;
+  }
+  return p;
+}
+
+// Index is the type used for positions and child-index arithmetic. Heaps
+// that stay under 4 billion slots (elements plus offset) can use
+// std::uint32_t, which halves the size of every index and of any side table
+// keyed by position.
+//
+// Instrument is a policy in the style of NoInstrument; policies derive from
+// it and hide the hooks they care about. Heap derives from the policy
+// privately, so a stateless policy takes no space; instrument() exposes it.
+template <typename T, typename Index = std::size_t, typename Instrument = NoInstrument>
+class Heap : private Instrument {
+  static_assert(std::is_integral<Index>::value && std::is_unsigned<Index>::value,
+                "Heap index type must be an unsigned integer");
+
  public:
+  using index_type = Index;
+  using instrument_type = Instrument;
+
   // Assumes T has a size constructor
-  Heap(std::size_t n) : heap_(std::make_unique<T>(n + offset_)), size_(n) {}
+  Heap(std::size_t n)
+      : heap_(allocate(checked_index(n))),
+        size_(checked_index(n)),
+        capacity_(size_) {}
   Heap(const std::vector<T>& v)
-      : heap_(std::make_unique<T[]>(v.size())), size_(v.size()) {
-    for (std::size_t i = 0; i < v.size(); ++i) {
-      heap_[offset_ + i] = v[i];
+      : Heap(v, 0) {}
+  Heap(const std::vector<T>& v, std::size_t offset)
+      : size_(static_cast<index_type>(v.size())),
+        capacity_(size_),
+        offset_(static_cast<index_type>(offset)) {
+    OpScope scope(*this, HeapOp::kBuild);
+    heap_ = allocate(checked_index(v.size(), offset));
+    for (index_type i = 0; i < size_; ++i) {
+      slot(i) = v[i];
+      this->on_move();
     }
     heapify();
   }
-  Heap(const std::vector<T>& v, std::size_t offset)
-      : heap_(std::make_unique<T[]>(v.size() + offset)),
-        offset_(offset),
-        size_(v.size()) {
-    for (std::size_t i = 0; i < v.size(); ++i) {
-      heap_[offset_ + i] = v[i];
+
+  index_type size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  T Top() const { return slot(0); }
+
+  void Push(T x) {
+    OpScope scope(*this, HeapOp::kPush);
+    if (size_ == capacity_) {
+      reserve(capacity_ == 0 ? 1 : 2 * static_cast<std::size_t>(capacity_));
     }
-    heapify();
+    sift_up(size_++, std::move(x));
+  }
+
+  // Removes and returns the smallest element. The heap must not be empty.
+  T Pop() {
+    OpScope scope(*this, HeapOp::kPop);
+    T top = std::move(slot(0));
+    if (--size_ > 0) sift_down(0, std::move(slot(size_)));
+    return top;
   }
 
-  ~Heap() { heap_.release(); }
+  // Element at position pos; 0 is the top.
+  T At(index_type pos) const { return slot(pos); }
 
-  std::size_t size() { return size_; }
+  // Replaces the element at position pos and restores heap order: sifts up
+  // for a decrease-key, down for an increase.
+  void Update(index_type pos, T x) {
+    OpScope scope(*this, HeapOp::kUpdate);
+    if (less(x, slot(pos))) {
+      sift_up(pos, std::move(x));
+    } else {
+      sift_down(pos, std::move(x));
+    }
+  }
 
-  T Top() { return heap_[offset_]; }
+  // Moves every element of other (not this heap) into this one and leaves
+  // other empty. An array heap can do no better than pushing them one by
+  // one, each reported as a push: O(m log(n + m)) at worst.
+  void Meld(Heap& other) {
+    const std::size_t size = static_cast<std::size_t>(size_) + other.size_;
+    if (size > capacity_) reserve(std::max(size, 2 * static_cast<std::size_t>(capacity_)));
+    for (index_type i = 0; i < other.size_; ++i) Push(std::move(other.slot(i)));
+    other.size_ = 0;
+  }
 
-  void set_offset(std::size_t offset) {
-    offset_ = offset;
-    heapify();
+  void reserve(std::size_t capacity) {
+    if (capacity > capacity_) relocate(capacity, offset_);
+  }
+
+  void set_offset(std::size_t offset) { relocate(capacity_, offset); }
+
+  // Applies fn to every element in place. fn must be non-decreasing, so the
+  // heap order survives without re-sifting.
+  template <typename Fn>
+  void Remap(Fn fn) {
+    for (index_type i = 0; i < size_; ++i) slot(i) = fn(slot(i));
+  }
+
+  Instrument& instrument() { return *this; }
+  const Instrument& instrument() const { return *this; }
+
+  // Layout of the heap array, with sibling groups checked against line.
+  HeapStats Stats(std::size_t line = kCacheLineSize) const {
+    const std::size_t slots = static_cast<std::size_t>(capacity_) + offset_;
+    return heap_stats(heap_.get(), sizeof(T), size_, capacity_, offset_, slots * sizeof(T),
+                      line);
   }
 
   friend std::ostream& operator<<(std::ostream& os, const Heap& h) {
     os << "[ ";
-    for (std::size_t i = 0; i < h.size_ + h.offset_; ++i) {
+    for (index_type i = 0; i < h.size_ + h.offset_; ++i) {
       os << h.heap_[i] << ' ';
     }
     os << "]";
@@ -72,98 +851,4834 @@ class Heap {
  private:
   void heapify();
 
-  void swap_idx(std::size_t idx1, std::size_t idx2) {
-    auto tmp = heap_[idx1];
-    heap_[idx1] = heap_[idx2];
-    heap_[idx2] = tmp;
+  // Sifting moves a hole instead of swapping: the element being placed is
+  // held in x, the elements it passes are shifted one level into the hole,
+  // and x is written once at its final position. This costs one move per
+  // level instead of the three copies a swap needs.
+  void sift_up(index_type hole, T x);
+  void sift_down(index_type hole, T x);
+
+  void relocate(std::size_t capacity, std::size_t offset);
+
+  // Reports a public operation's start and end to the policy.
+  class OpScope {
+   public:
+    OpScope(Heap& heap, HeapOp op) : heap_(heap), op_(op) { heap_.on_begin(op_); }
+    ~OpScope() { heap_.on_end(op_); }
+
+   private:
+    Heap& heap_;
+    HeapOp op_;
+  };
+
+  bool less(const T& a, const T& b) {
+    this->on_compare();
+    return a < b;
+  }
+
+  std::unique_ptr<T[]> allocate(index_type slots) {
+    this->on_alloc(static_cast<std::size_t>(slots) * sizeof(T));
+    return std::make_unique<T[]>(slots);
   }
 
-  std::size_t last_parent() {
-    return static_cast<std::size_t>(std::log2(size_ + 1));
+  // Element at position idx, reported to the policy as an access to its
+  // array slot. Const readers report too: observing accesses isn't a change
+  // to the heap.
+  T& slot(index_type idx) {
+    this->on_access(static_cast<std::size_t>(offset_) + idx);
+    return heap_[offset_ + idx];
+  }
+  const T& slot(index_type idx) const {
+    const_cast<Heap*>(this)->on_access(static_cast<std::size_t>(offset_) + idx);
+    return heap_[offset_ + idx];
+  }
+
+  // Returns n + offset as an index_type, throwing if the slots don't fit.
+  static index_type checked_index(std::size_t n, std::size_t offset = 0) {
+    if (n > std::numeric_limits<index_type>::max() ||
+        offset > std::numeric_limits<index_type>::max() - n) {
+      throw std::length_error("Heap: size exceeds the range of its index type");
+    }
+    return static_cast<index_type>(n + offset);
   }
-  std::size_t lchild_index(std::size_t idx) { return (idx - offset_) * 2 + 1 + offset_; }
-  std::size_t rchild_index(std::size_t idx) { return (idx - offset_) * 2 + 2 + offset_; }
+
+  // Positions are relative to the root at heap_[offset_].
+  static index_type parent_index(index_type idx) { return (idx - 1) / 2; }
+  static index_type lchild_index(index_type idx) { return idx * 2 + 1; }
 
   // Member variables
   std::unique_ptr<T[]> heap_;
-  std::size_t size_;
-  std::size_t offset_ = 0;
+  index_type size_;
+  index_type capacity_;
+  index_type offset_ = 0;
 
 };  // class Heap
 
+// Heap with 32-bit positions, for heaps known to hold fewer than 2^32 slots.
 template <typename T>
-void Heap<T>::heapify() {
-  std::stack<std::size_t> index_stack;
-  index_stack.push(static_cast<std::size_t>(offset_ + size_));
-  while (!index_stack.empty()) {
-    const auto parent_idx = index_stack.top();
-    index_stack.pop();
+using CompactHeap = Heap<T, std::uint32_t>;
 
-    if (parent_idx > offset_) {
-      index_stack.push(parent_idx - 1);
-    }
-    if (lchild_index(parent_idx) > offset_ + size_ - 1 && rchild_index(parent_idx) > offset_ + size_ - 1) continue;
+// Floyd's bottom-up build: sift every parent down, last parent first.
+template <typename T, typename Index, typename Instrument>
+void Heap<T, Index, Instrument>::heapify() {
+  for (index_type i = size_ / 2; i-- > 0;) {
+    sift_down(i, std::move(slot(i)));
+  }
+}
 
-    auto lchild = heap_[lchild_index(parent_idx)];
-    auto rchild = heap_[rchild_index(parent_idx)];
+template <typename T, typename Index, typename Instrument>
+void Heap<T, Index, Instrument>::sift_up(index_type hole, T x) {
+  while (hole > 0) {
+    const index_type parent = parent_index(hole);
+    if (!less(x, slot(parent))) break;
+    slot(hole) = std::move(slot(parent));
+    this->on_move();
+    this->on_level();
+    hole = parent;
+  }
+  slot(hole) = std::move(x);
+  this->on_move();
+}
 
-    if (lchild_index(parent_idx) < offset_ + size_ && lchild < heap_[parent_idx]) {
-      swap_idx(lchild_index(parent_idx), parent_idx);
-      index_stack.push(lchild_index(parent_idx));
-    }
-    if (rchild_index(parent_idx) < offset_ + size_ && rchild < heap_[parent_idx]) {
-      swap_idx(rchild_index(parent_idx), parent_idx);
-      index_stack.push(rchild_index(parent_idx));
-    }
+template <typename T, typename Index, typename Instrument>
+void Heap<T, Index, Instrument>::sift_down(index_type hole, T x) {
+  // Only positions below size_ / 2 have children; testing that instead of
+  // the child index keeps 2 * hole + 1 from overflowing a 32-bit index.
+  const index_type first_leaf = size_ / 2;
+  while (hole < first_leaf) {
+    index_type child = lchild_index(hole);
+    if (child + 1 < size_ && less(slot(child + 1), slot(child))) ++child;
+    if (!less(slot(child), x)) break;
+    slot(hole) = std::move(slot(child));
+    this->on_move();
+    this->on_level();
+    hole = child;
   }
+  slot(hole) = std::move(x);
+  this->on_move();
 }
 
-int main() {
-  using steady_clock = std::chrono::steady_clock;
+template <typename T, typename Index, typename Instrument>
+void Heap<T, Index, Instrument>::relocate(std::size_t capacity, std::size_t offset) {
+  auto heap = allocate(checked_index(capacity, offset));
+  for (index_type i = 0; i < size_; ++i) {
+    heap[offset + i] = std::move(heap_[offset_ + i]);
+    this->on_move();
+  }
+  heap_ = std::move(heap);
+  capacity_ = static_cast<index_type>(capacity);
+  offset_ = static_cast<index_type>(offset);
+}
+
+// Heap of arithmetic priorities that can all be aged at once in O(1). Stored
+// values are kept relative to a global affine map, real = stored * scale +
+// bias, which is applied when an element is read and inverted when one is
+// pushed. Since the map is increasing, comparisons run on the stored values
+// unchanged. Shift() adds to every priority; Scale() multiplies every priority
+// by a positive factor (floating-point T only).
+template <typename T, typename Index = std::size_t>
+class AgingHeap {
+  static_assert(std::is_arithmetic<T>::value, "AgingHeap requires an arithmetic T");
 
-  std::cout << "#######\n"
-            << " START\n"
-            << "######\n";
-  constexpr int N = 5000;
-  constexpr int N_TRIALS = 50;
-  using value_type = float;
-  std::vector<value_type> v;
-  for (int i = N; i > 0; --i) v.push_back(static_cast<value_type>(i));
-  std::cout << "Warming up cache...\n";
-  for (int i = 0; i < N_TRIALS; ++i) volatile Heap<value_type> h(v);
+ public:
+  using index_type = Index;
+
+  AgingHeap() : heap_(std::size_t{0}) {}
+  AgingHeap(const std::vector<T>& v, std::size_t offset = 0) : heap_(v, offset) {}
+
+  index_type size() const { return heap_.size(); }
+  bool empty() const { return heap_.empty(); }
+
+  T Top() const { return to_real(heap_.Top()); }
+  T Pop() { return to_real(heap_.Pop()); }
+  void Push(T x) { heap_.Push((x - bias_) / scale_); }
+
+  void Shift(T delta) { bias_ += delta; }
+
+  void Scale(T factor) {
+    static_assert(std::is_floating_point<T>::value,
+                  "AgingHeap::Scale requires a floating-point T");
+    if (!(factor > 0)) throw std::invalid_argument("AgingHeap: factor must be positive");
+    scale_ *= factor;
+    bias_ *= factor;
+    // Keep stored values within a few exponents of the real ones.
+    if (scale_ < 1 / kMaxScaleDrift || scale_ > kMaxScaleDrift) Rebase();
+  }
+
+  // Folds the global map into the stored values, an O(n) pass. Callers that
+  // Shift() integer priorities unboundedly should rebase before bias
+  // arithmetic can overflow.
+  void Rebase() {
+    const T scale = scale_;
+    const T bias = bias_;
+    heap_.Remap([scale, bias](T x) { return x * scale + bias; });
+    scale_ = 1;
+    bias_ = 0;
+  }
+
+  // Moves every priority of other into this heap and leaves other empty.
+  // other's stored values are first mapped into this heap's frame; the map
+  // is increasing, so their heap order survives.
+  void Meld(AgingHeap& other) {
+    const T scale = other.scale_ / scale_;
+    const T bias = (other.bias_ - bias_) / scale_;
+    other.heap_.Remap([scale, bias](T x) { return x * scale + bias; });
+    heap_.Meld(other.heap_);
+    other.scale_ = 1;
+    other.bias_ = 0;
+  }
+
+  void set_offset(std::size_t offset) { heap_.set_offset(offset); }
+
+  HeapStats Stats(std::size_t line = kCacheLineSize) const { return heap_.Stats(line); }
+
+ private:
+  static constexpr double kMaxScaleDrift = 4294967296.0;  // 2^32
+
+  T to_real(T stored) const { return stored * scale_ + bias_; }
+
+  Heap<T, Index> heap_;
+  T scale_ = 1;
+  T bias_ = 0;
+
+};  // class AgingHeap
+
+template <typename T, typename Index>
+constexpr double AgingHeap<T, Index>::kMaxScaleDrift;
+
+// Element of a KeyedHeap: the ordering key, computed once on insertion, next
+// to a pointer to the record it was derived from. Comparisons only read key.
+template <typename Key, typename Payload>
+struct KeyedEntry {
+  Key key;
+  const Payload* payload;
+
+  bool operator<(const KeyedEntry& other) const { return key < other.key; }
+};
+
+template <typename Key, typename Payload>
+std::ostream& operator<<(std::ostream& os, const KeyedEntry<Key, Payload>& e) {
+  return os << e.key;
+}
+
+// Decorate-sort heap for records whose ordering key is expensive to derive.
+// KeyFn maps a const Payload& to a cheap, comparable key and is called exactly
+// once per record. The heap stores references: pushed records must outlive it.
+template <typename Payload, typename KeyFn, typename Index = std::size_t>
+class KeyedHeap {
+ public:
+  using key_type = typename std::decay<decltype(
+      std::declval<KeyFn&>()(std::declval<const Payload&>()))>::type;
+  using entry_type = KeyedEntry<key_type, Payload>;
+  using index_type = Index;
+
+  explicit KeyedHeap(KeyFn key_fn = KeyFn())
+      : heap_(std::size_t{0}), key_fn_(std::move(key_fn)) {}
+  KeyedHeap(const std::vector<Payload>& v, KeyFn key_fn = KeyFn(),
+            std::size_t offset = 0)
+      : heap_(decorate(v, key_fn), offset), key_fn_(std::move(key_fn)) {}
+
+  index_type size() const { return heap_.size(); }
+  bool empty() const { return heap_.empty(); }
+
+  const Payload& Top() const { return *heap_.Top().payload; }
+  key_type TopKey() const { return heap_.Top().key; }
+
+  void Push(const Payload& p) { heap_.Push(entry_type{key_fn_(p), &p}); }
+
+  // Removes the record with the smallest key and returns it.
+  const Payload& Pop() { return *heap_.Pop().payload; }
+
+  void set_offset(std::size_t offset) { heap_.set_offset(offset); }
+
+ private:
+  static std::vector<entry_type> decorate(const std::vector<Payload>& v,
+                                          KeyFn& key_fn) {
+    std::vector<entry_type> entries;
+    entries.reserve(v.size());
+    for (const auto& p : v) entries.push_back(entry_type{key_fn(p), &p});
+    return entries;
+  }
+
+  Heap<entry_type, Index> heap_;
+  KeyFn key_fn_;
+
+};  // class KeyedHeap
+
+template <typename Payload, typename KeyFn>
+KeyedHeap<Payload, KeyFn> make_keyed_heap(KeyFn key_fn) {
+  return KeyedHeap<Payload, KeyFn>(std::move(key_fn));
+}
+
+template <typename Payload, typename KeyFn>
+KeyedHeap<Payload, KeyFn> make_keyed_heap(const std::vector<Payload>& v,
+                                          KeyFn key_fn,
+                                          std::size_t offset = 0) {
+  return KeyedHeap<Payload, KeyFn>(v, std::move(key_fn), offset);
+}
 
-  std::cout << "Building heap\n";
+// Binary operation trace. After an 8-byte "HEAPTRC1" header, each record is
+// a TraceOp byte followed by its operands: a push carries its key, an update
+// a LEB128 position and the amount the key at that position went down by.
+// Keys and amounts are doubles in host byte order.
+enum class TraceOp : std::uint8_t { kPush, kPop, kUpdate };
 
-  std::vector<double> standard_offset(N_TRIALS);
+constexpr char kTraceMagic[8] = {'H', 'E', 'A', 'P', 'T', 'R', 'C', '1'};
 
-  for (int i = 0; i < N_TRIALS; ++i) {
-    auto start = steady_clock::now();
-    Heap<value_type> h(v, 0);
-    auto stop = steady_clock::now();
+struct TraceRecord {
+  TraceOp op;
+  std::uint64_t pos;  // kUpdate only
+  double value;       // kPush key or kUpdate decrease
+};
 
-    std::chrono::duration<double> elapsed = stop - start;
-    standard_offset[i] = elapsed.count();
+class TraceWriter {
+ public:
+  explicit TraceWriter(std::ostream& os) : os_(os) { os_.write(kTraceMagic, sizeof(kTraceMagic)); }
+
+  void Push(double key) {
+    put(TraceOp::kPush);
+    put_double(key);
   }
+  void Pop() { put(TraceOp::kPop); }
+  void Update(std::uint64_t pos, double decrease) {
+    put(TraceOp::kUpdate);
+    do {
+      const auto low = static_cast<char>(pos & 0x7f);
+      pos >>= 7;
+      os_.put(pos ? static_cast<char>(low | 0x80) : low);
+    } while (pos);
+    put_double(decrease);
+  }
+
+ private:
+  void put(TraceOp op) { os_.put(static_cast<char>(op)); }
+  void put_double(double d) { os_.write(reinterpret_cast<const char*>(&d), sizeof(d)); }
+
+  std::ostream& os_;
+};
 
-  double standard_time = std::accumulate(standard_offset.begin(), standard_offset.end(), 0.0)/N_TRIALS;
-  std::cout << "Averaged over " << N_TRIALS << " runs\n";
-  std::cout << "\tStandard layout heap built in " << standard_time << " seconds\n";
+class TraceReader {
+ public:
+  // Throws std::runtime_error unless is starts with a trace header.
+  explicit TraceReader(std::istream& is) : is_(is) {
+    char magic[sizeof(kTraceMagic)];
+    if (!is_.read(magic, sizeof(magic)) ||
+        !std::equal(magic, magic + sizeof(magic), kTraceMagic)) {
+      throw std::runtime_error("not a heap operation trace");
+    }
+  }
 
-  for (int i = 0; i < 10; ++i) {
-    std::vector<double> h_offset(N_TRIALS);
-    for (int j = 0; j < N_TRIALS; ++j) {
-      // Time heap construction
-      auto start = steady_clock::now();
-      Heap<value_type> ho(v, i);
-      auto stop = steady_clock::now();
+  // Reads the next record; returns false at the end of the trace. Throws
+  // std::runtime_error on a truncated or corrupt record.
+  bool Next(TraceRecord& r) {
+    const int op = is_.get();
+    if (op == std::char_traits<char>::eof()) return false;
+    r.op = static_cast<TraceOp>(op);
+    r.pos = 0;
+    r.value = 0;
+    switch (r.op) {
+      case TraceOp::kPush:
+        get_double(r.value);
+        break;
+      case TraceOp::kPop:
+        break;
+      case TraceOp::kUpdate:
+        for (int shift = 0;; shift += 7) {
+          const int byte = is_.get();
+          if (byte == std::char_traits<char>::eof() || shift > 63) {
+            throw std::runtime_error("truncated heap operation trace");
+          }
+          r.pos |= static_cast<std::uint64_t>(byte & 0x7f) << shift;
+          if (!(byte & 0x80)) break;
+        }
+        get_double(r.value);
+        break;
+      default:
+        throw std::runtime_error("corrupt heap operation trace");
+    }
+    return true;
+  }
 
-      std::chrono::duration<double> elapsed = stop - start;
-      h_offset[j] = elapsed.count();
+ private:
+  void get_double(double& d) {
+    if (!is_.read(reinterpret_cast<char*>(&d), sizeof(d))) {
+      throw std::runtime_error("truncated heap operation trace");
     }
-    double time = std::accumulate(h_offset.begin(), h_offset.end(), 0.0)/N_TRIALS;
-    std::cout << "\tHeap offset used: " << i << " heap built in " << time << " seconds (" << time / standard_time << "\% of standard)\n";
+  }
+
+  std::istream& is_;
+};
+
+// Default key projection for RecordingHeap.
+struct TraceKey {
+  template <typename T>
+  double operator()(const T& x) const {
+    return static_cast<double>(x);
+  }
+};
 
+// Wraps a heap and logs every operation made through the wrapper to a
+// TraceWriter. The heap's current contents are logged first, as pushes in
+// array order, so the trace replays from an empty heap. HeapT needs the
+// Heap interface (size, At, Push, Pop, Update); KeyFn maps elements to the
+// double keys stored in the trace.
+template <typename HeapT, typename KeyFn = TraceKey>
+class RecordingHeap {
+ public:
+  using value_type = decltype(std::declval<HeapT&>().Pop());
+  using index_type = typename HeapT::index_type;
+
+  RecordingHeap(HeapT& heap, std::ostream& os, KeyFn key_fn = KeyFn())
+      : heap_(heap), trace_(os), key_fn_(std::move(key_fn)) {
+    for (index_type i = 0; i < heap_.size(); ++i) trace_.Push(key_fn_(heap_.At(i)));
+  }
+
+  index_type size() const { return heap_.size(); }
+  bool empty() const { return heap_.empty(); }
+  value_type Top() const { return heap_.Top(); }
+  value_type At(index_type pos) const { return heap_.At(pos); }
+
+  void Push(value_type x) {
+    trace_.Push(key_fn_(x));
+    heap_.Push(std::move(x));
+  }
+  value_type Pop() {
+    trace_.Pop();
+    return heap_.Pop();
+  }
+  void Update(index_type pos, value_type x) {
+    trace_.Update(pos, key_fn_(heap_.At(pos)) - key_fn_(x));
+    heap_.Update(pos, std::move(x));
   }
 
+ private:
+  HeapT& heap_;
+  TraceWriter trace_;
+  KeyFn key_fn_;
+};
+
+template <typename HeapT>
+RecordingHeap<HeapT> make_recording_heap(HeapT& heap, std::ostream& os) {
+  return RecordingHeap<HeapT>(heap, os);
+}
+
+// Fixed-size array whose first element starts on a cache-line boundary. T
+// must be trivial; elements are value-initialized.
+template <typename T>
+class AlignedArray {
+  static_assert(std::is_trivial<T>::value, "AlignedArray requires a trivial T");
+
+ public:
+  AlignedArray() = default;
+  explicit AlignedArray(std::size_t n)
+      : raw_(std::make_unique<unsigned char[]>(bytes(n))), size_(n) {
+    void* p = raw_.get();
+    std::size_t space = bytes(n);
+    data_ = static_cast<T*>(std::align(kCacheLineSize, n * sizeof(T), p, space));
+    for (std::size_t i = 0; i < n; ++i) new (data_ + i) T();
+  }
+
+  T& operator[](std::size_t i) { return data_[i]; }
+  const T& operator[](std::size_t i) const { return data_[i]; }
+  T* data() { return data_; }
+  const T* data() const { return data_; }
+
+  // Bytes allocated, alignment slack included.
+  std::size_t allocated_bytes() const { return data_ ? bytes(size_) : 0; }
+
+ private:
+  static std::size_t bytes(std::size_t n) { return n * sizeof(T) + kCacheLineSize; }
+
+  std::unique_ptr<unsigned char[]> raw_;
+  T* data_ = nullptr;
+  std::size_t size_ = 0;
+};
+
+// Min-heap over rows of a composite priority (Cols...) compared
+// lexicographically. Each column lives in its own cache-aligned array, so the
+// first column, which decides almost every comparison, stays densely packed;
+// later columns are only read to break ties. Offset shifts the root within
+// every column, as for Heap.
+template <typename Index, typename... Cols>
+class BasicLexHeap {
+  static_assert(sizeof...(Cols) > 0, "LexHeap needs at least one column");
+  static_assert(std::is_integral<Index>::value && std::is_unsigned<Index>::value,
+                "LexHeap index type must be an unsigned integer");
+
+ public:
+  using index_type = Index;
+  using row_type = std::tuple<Cols...>;
+
+  explicit BasicLexHeap(std::size_t capacity = 0, std::size_t offset = 0)
+      : capacity_(checked_index(capacity, offset) - static_cast<index_type>(offset)),
+        offset_(static_cast<index_type>(offset)) {
+    allocate(columns_, capacity_ + offset_, Indices());
+  }
+  BasicLexHeap(const std::vector<row_type>& rows, std::size_t offset = 0)
+      : BasicLexHeap(rows.size(), offset) {
+    for (const auto& row : rows) store(size_++, row, Indices());
+    heapify();
+  }
+
+  index_type size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  row_type Top() const { return load(0, Indices()); }
+
+  void Push(const row_type& row) {
+    if (size_ == capacity_) {
+      grow(capacity_ == 0 ? 1 : 2 * static_cast<std::size_t>(capacity_));
+    }
+    sift_up(size_++, row);
+  }
+  void Push(const Cols&... values) { Push(row_type(values...)); }
+
+  // Removes and returns the smallest row. The heap must not be empty.
+  row_type Pop() {
+    row_type top = load(0, Indices());
+    if (--size_ > 0) sift_down(0, load(size_, Indices()));
+    return top;
+  }
+
+  row_type At(index_type pos) const { return load(pos, Indices()); }
+
+  // Replaces the row at position pos and restores heap order.
+  void Update(index_type pos, const row_type& row) {
+    if (less(row, pos)) {
+      sift_up(pos, row);
+    } else {
+      sift_down(pos, row);
+    }
+  }
+
+  // Moves every row of other (not this heap) into this one by pushing it,
+  // and leaves other empty.
+  void Meld(BasicLexHeap& other) {
+    const std::size_t size = static_cast<std::size_t>(size_) + other.size_;
+    if (size > capacity_) grow(std::max(size, 2 * static_cast<std::size_t>(capacity_)));
+    for (index_type i = 0; i < other.size_; ++i) Push(other.load(i, Indices()));
+    other.size_ = 0;
+  }
+
+  // Layout of the first column, which decides almost every comparison;
+  // bytes covers all columns.
+  HeapStats Stats(std::size_t line = kCacheLineSize) const {
+    return heap_stats(std::get<0>(columns_).data(), sizeof(typename std::tuple_element<0, row_type>::type), size_,
+                      capacity_, offset_, allocated_bytes(Indices()), line);
+  }
+
+ private:
+  using Indices = std::index_sequence_for<Cols...>;
+  using columns_type = std::tuple<AlignedArray<Cols>...>;
+
+  void heapify() {
+    for (index_type i = size_ / 2; i-- > 0;) sift_down(i, load(i, Indices()));
+  }
+
+  void sift_up(index_type hole, const row_type& x) {
+    while (hole > 0) {
+      const index_type parent = (hole - 1) / 2;
+      if (!less(x, parent)) break;
+      move_row(hole, parent, Indices());
+      hole = parent;
+    }
+    store(hole, x, Indices());
+  }
+
+  void sift_down(index_type hole, const row_type& x) {
+    const index_type first_leaf = size_ / 2;
+    while (hole < first_leaf) {
+      index_type child = hole * 2 + 1;
+      if (child + 1 < size_ && less(child + 1, child)) ++child;
+      if (!less(child, x)) break;
+      move_row(hole, child, Indices());
+      hole = child;
+    }
+    store(hole, x, Indices());
+  }
+
+  // Column I of a held row or of the row at a position.
+  template <std::size_t I>
+  const auto& field(const row_type& row) const { return std::get<I>(row); }
+  template <std::size_t I>
+  const auto& field(index_type idx) const {
+    return std::get<I>(columns_)[offset_ + idx];
+  }
+
+  template <typename A, typename B>
+  bool less(const A& a, const B& b) const {
+    return lex_less<0>(a, b, std::true_type());
+  }
+  template <std::size_t I, typename A, typename B>
+  bool lex_less(const A&, const B&, std::false_type) const { return false; }
+  template <std::size_t I, typename A, typename B>
+  bool lex_less(const A& a, const B& b, std::true_type) const {
+    const auto& x = field<I>(a);
+    const auto& y = field<I>(b);
+    if (x < y) return true;
+    if (y < x) return false;
+    return lex_less<I + 1>(
+        a, b, std::integral_constant<bool, (I + 1 < sizeof...(Cols))>());
+  }
+
+  template <std::size_t... I>
+  row_type load(index_type idx, std::index_sequence<I...>) const {
+    return row_type(std::get<I>(columns_)[offset_ + idx]...);
+  }
+  template <std::size_t... I>
+  void store(index_type idx, const row_type& row, std::index_sequence<I...>) {
+    int expand[] = {(std::get<I>(columns_)[offset_ + idx] = std::get<I>(row), 0)...};
+    (void)expand;
+  }
+  template <std::size_t... I>
+  void move_row(index_type dst, index_type src, std::index_sequence<I...>) {
+    int expand[] = {(std::get<I>(columns_)[offset_ + dst] =
+                         std::get<I>(columns_)[offset_ + src], 0)...};
+    (void)expand;
+  }
+
+  template <std::size_t... I>
+  std::size_t allocated_bytes(std::index_sequence<I...>) const {
+    std::size_t total = 0;
+    int expand[] = {(total += std::get<I>(columns_).allocated_bytes(), 0)...};
+    (void)expand;
+    return total;
+  }
+
+  template <std::size_t... I>
+  static void allocate(columns_type& columns, std::size_t n, std::index_sequence<I...>) {
+    columns = columns_type(AlignedArray<Cols>(n)...);
+  }
+
+  void grow(std::size_t capacity) {
+    columns_type columns;
+    allocate(columns, checked_index(capacity, offset_), Indices());
+    copy_columns(columns, Indices());
+    columns_ = std::move(columns);
+    capacity_ = static_cast<index_type>(capacity);
+  }
+  template <std::size_t... I>
+  void copy_columns(columns_type& to, std::index_sequence<I...>) const {
+    int expand[] = {(std::copy(std::get<I>(columns_).data() + offset_,
+                               std::get<I>(columns_).data() + offset_ + size_,
+                               std::get<I>(to).data() + offset_), 0)...};
+    (void)expand;
+  }
+
+  static index_type checked_index(std::size_t n, std::size_t offset = 0) {
+    if (n > std::numeric_limits<index_type>::max() ||
+        offset > std::numeric_limits<index_type>::max() - n) {
+      throw std::length_error("LexHeap: size exceeds the range of its index type");
+    }
+    return static_cast<index_type>(n + offset);
+  }
+
+  // Member variables
+  columns_type columns_;
+  index_type size_ = 0;
+  index_type capacity_;
+  index_type offset_;
+
+};  // class BasicLexHeap
+
+template <typename... Cols>
+using LexHeap = BasicLexHeap<std::size_t, Cols...>;
+
+template <typename... Cols>
+using CompactLexHeap = BasicLexHeap<std::uint32_t, Cols...>;
+
+// Free-list allocator of Node objects carved from cache-aligned slabs, so
+// a node whose size divides the line never straddles two lines. Free nodes
+// are chained through their next member. Each new slab holds as many nodes
+// as the pool already owns, so there are O(log n) allocations for n nodes.
+template <typename Node>
+class NodePool {
+ public:
+  NodePool() = default;
+  NodePool(NodePool&& other) noexcept { Splice(other); }
+  NodePool& operator=(NodePool&& other) noexcept {
+    slabs_.clear();
+    free_ = free_tail_ = nullptr;
+    capacity_ = available_ = 0;
+    Splice(other);
+    return *this;
+  }
+
+  Node* Allocate() {
+    if (!free_) grow(std::max(capacity_, kMinSlabNodes));
+    Node* node = free_;
+    free_ = node->next;
+    if (!free_) free_tail_ = nullptr;
+    --available_;
+    return node;
+  }
+
+  void Free(Node* node) {
+    node->next = free_;
+    if (!free_) free_tail_ = node;
+    free_ = node;
+    ++available_;
+  }
+
+  // Makes sure the next nodes allocations need no new slab.
+  void reserve(std::size_t nodes) {
+    if (nodes > available_) grow(nodes - available_);
+  }
+
+  // Takes over other's slabs and free nodes and leaves it empty, in O(1).
+  // Nodes stay where they are, so pointers to other's nodes remain valid.
+  void Splice(NodePool& other) {
+    slabs_.splice(slabs_.end(), other.slabs_);
+    if (other.free_) {
+      other.free_tail_->next = free_;
+      if (!free_) free_tail_ = other.free_tail_;
+      free_ = other.free_;
+    }
+    capacity_ += other.capacity_;
+    available_ += other.available_;
+    other.free_ = other.free_tail_ = nullptr;
+    other.capacity_ = other.available_ = 0;
+  }
+
+  std::size_t capacity() const { return capacity_; }
+
+  // Start of the first slab, or null before any allocation.
+  const Node* first_slab() const { return slabs_.empty() ? nullptr : slabs_.front().data(); }
+
+  // Bytes allocated, alignment slack included.
+  std::size_t allocated_bytes() const {
+    std::size_t total = 0;
+    for (const auto& slab : slabs_) total += slab.allocated_bytes();
+    return total;
+  }
+
+ private:
+  static constexpr std::size_t kMinSlabNodes = std::max<std::size_t>(4096 / sizeof(Node), 1);
+
+  void grow(std::size_t nodes) {
+    slabs_.emplace_back(nodes);
+    Node* slab = slabs_.back().data();
+    for (std::size_t i = 0; i + 1 < nodes; ++i) slab[i].next = slab + i + 1;
+    slab[nodes - 1].next = free_;
+    if (!free_) free_tail_ = slab + nodes - 1;
+    free_ = slab;
+    capacity_ += nodes;
+    available_ += nodes;
+  }
+
+  // A list, so that Splice() moves slabs without touching them.
+  std::list<AlignedArray<Node>> slabs_;
+  Node* free_ = nullptr;
+  Node* free_tail_ = nullptr;
+  std::size_t capacity_ = 0;   // nodes owned
+  std::size_t available_ = 0;  // nodes on the free list
+};
+
+template <typename Node>
+constexpr std::size_t NodePool<Node>::kMinSlabNodes;
+
+// Pairing heap: a min-ordered tree of pooled nodes, each linking to its
+// first child and its siblings. Meld links two roots in O(1), and lowering
+// a key cuts the node's subtree and links it to the root in O(1); Pop
+// merges the root's children in two passes, O(log n) amortized. Push
+// returns a handle to the element's node, valid until it is popped, for
+// At() and Update(). T must be trivial, like AlignedArray's.
+template <typename T>
+class PairingHeap {
+  static_assert(std::is_trivial<T>::value, "PairingHeap requires a trivial T");
+
+  struct Node {
+    T key;
+    Node* child;  // first child
+    Node* next;   // next sibling; the free list in the pool
+    Node* prev;   // previous sibling, or the parent of a first child
+  };
+
+ public:
+  using handle_type = Node*;
+
+  PairingHeap() = default;
+  explicit PairingHeap(std::size_t capacity) { pool_.reserve(capacity); }
+  // Links the elements pairwise in rounds, a balanced O(n) build.
+  PairingHeap(const std::vector<T>& v) : size_(v.size()) {
+    pool_.reserve(v.size());
+    std::vector<Node*> roots;
+    roots.reserve(v.size());
+    for (const auto& x : v) roots.push_back(make_node(x));
+    for (std::size_t width = 1; width < roots.size(); width *= 2) {
+      for (std::size_t i = 0; i + width < roots.size(); i += 2 * width) {
+        roots[i] = link(roots[i], roots[i + width]);
+      }
+    }
+    root_ = roots.empty() ? nullptr : roots.front();
+  }
+
+  PairingHeap(PairingHeap&& other) noexcept
+      : pool_(std::move(other.pool_)),
+        root_(std::exchange(other.root_, nullptr)),
+        size_(std::exchange(other.size_, 0)) {}
+  PairingHeap& operator=(PairingHeap&& other) noexcept {
+    pool_ = std::move(other.pool_);
+    root_ = std::exchange(other.root_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+    return *this;
+  }
+
+  std::size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  T Top() const { return root_->key; }
+
+  handle_type Push(T x) {
+    Node* node = make_node(x);
+    root_ = meld_roots(root_, node);
+    ++size_;
+    return node;
+  }
+
+  // Removes and returns the smallest element. The heap must not be empty.
+  T Pop() {
+    Node* top = root_;
+    const T key = top->key;
+    root_ = merge_pairs(top->child);
+    pool_.Free(top);
+    --size_;
+    return key;
+  }
+
+  T At(handle_type node) const { return node->key; }
+
+  // Replaces the element at node and restores heap order. A decrease-key
+  // cuts the node's subtree and links it to the root; an increase merges
+  // the node's children in its place and links the node back on its own.
+  void Update(handle_type node, T x) {
+    if (x < node->key) {
+      node->key = x;
+      if (node != root_) {
+        cut(node);
+        root_ = link(root_, node);
+      }
+    } else if (node->key < x) {
+      node->key = x;
+      Node* children = node->child;
+      node->child = nullptr;
+      if (node == root_) {
+        root_ = nullptr;
+      } else {
+        cut(node);
+      }
+      root_ = meld_roots(meld_roots(root_, merge_pairs(children)), node);
+    }
+  }
+
+  // Moves every element of other (not this heap) into this one and leaves
+  // other empty: one link, plus taking over other's node pool. Handles into
+  // other stay valid, now in this heap.
+  void Meld(PairingHeap& other) {
+    root_ = meld_roots(root_, other.root_);
+    size_ += other.size_;
+    pool_.Splice(other.pool_);
+    other.root_ = nullptr;
+    other.size_ = 0;
+  }
+
+  // Layout of the node pool: capacity counts nodes, alignment is the first
+  // slab's, and depth is the tree's, found by visiting every node. Nodes
+  // have no sibling groups in one block, so none are reported.
+  HeapStats Stats(std::size_t line = kCacheLineSize) const {
+    HeapStats s;
+    s.size = size_;
+    s.capacity = pool_.capacity();
+    s.element_bytes = sizeof(T);
+    s.bytes = pool_.allocated_bytes();
+    const auto address = reinterpret_cast<std::uintptr_t>(pool_.first_slab());
+    s.alignment = static_cast<std::size_t>(address & (~address + 1));
+    s.line = line;
+    std::vector<std::pair<const Node*, std::size_t>> pending;
+    if (root_) pending.emplace_back(root_, 1);
+    while (!pending.empty()) {
+      const auto visit = pending.back();
+      pending.pop_back();
+      s.depth = std::max(s.depth, visit.second);
+      for (const Node* c = visit.first->child; c; c = c->next) {
+        pending.emplace_back(c, visit.second + 1);
+      }
+    }
+    return s;
+  }
+
+ private:
+  Node* make_node(const T& x) {
+    Node* node = pool_.Allocate();
+    *node = Node{x, nullptr, nullptr, nullptr};
+    return node;
+  }
+
+  // Makes the larger of two roots the first child of the other; ties keep
+  // a on top.
+  static Node* link(Node* a, Node* b) {
+    if (b->key < a->key) std::swap(a, b);
+    b->next = a->child;
+    if (a->child) a->child->prev = b;
+    b->prev = a;
+    a->child = b;
+    return a;
+  }
+
+  static Node* meld_roots(Node* a, Node* b) {
+    if (!a) return b;
+    if (!b) return a;
+    return link(a, b);
+  }
+
+  // Detaches a non-root node, with its subtree, from its parent.
+  static void cut(Node* node) {
+    if (node->prev->child == node) {
+      node->prev->child = node->next;
+    } else {
+      node->prev->next = node->next;
+    }
+    if (node->next) node->next->prev = node->prev;
+    node->next = node->prev = nullptr;
+  }
+
+  // Two-pass merge of a sibling list into one root: link adjacent pairs
+  // left to right, then fold the winners into one right to left. The
+  // winners are chained through next, last pair first, to avoid recursion.
+  static Node* merge_pairs(Node* first) {
+    Node* winners = nullptr;
+    while (first) {
+      Node* a = first;
+      Node* b = a->next;
+      first = b ? b->next : nullptr;
+      a->next = a->prev = nullptr;
+      if (b) {
+        b->next = b->prev = nullptr;
+        a = link(a, b);
+      }
+      a->next = winners;
+      winners = a;
+    }
+    Node* root = winners;
+    if (!root) return nullptr;
+    winners = root->next;
+    root->next = nullptr;
+    while (winners) {
+      Node* w = winners;
+      winners = w->next;
+      w->next = nullptr;
+      root = link(root, w);
+    }
+    return root;
+  }
+
+  // Member variables
+  NodePool<Node> pool_;
+  Node* root_ = nullptr;
+  std::size_t size_ = 0;
+
+};  // class PairingHeap
+
+//
+// Concurrent front ends
+//
+// Thread-safe wrappers around Heap<T> that trade ordering guarantees for
+// scalability. All take the expected number of threads, and share
+// Push(x) and TryPop(out), which returns false if the queue looked empty.
+
+// One Heap behind one mutex: exact order, no scaling.
+template <typename T>
+class LockedHeap {
+ public:
+  explicit LockedHeap(std::size_t /*threads*/) : heap_(std::size_t{0}) {}
+
+  void Push(T x) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    heap_.Push(std::move(x));
+  }
+
+  bool TryPop(T& out) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (heap_.empty()) return false;
+    out = heap_.Pop();
+    return true;
+  }
+
+ private:
+  std::mutex mutex_;
+  Heap<T> heap_;
+};
+
+// A Heap behind its own mutex, padded so neighbours don't share lines.
+template <typename T>
+struct LockedShard {
+  LockedShard() : heap(std::size_t{0}) {}
+
+  std::mutex mutex;
+  Heap<T> heap;
+  char padding[kCacheLineSize];
+};
+
+// One shard per thread. Threads push to their home shard and pop from it,
+// scanning the others only when it is empty: each shard is exact, the whole
+// only roughly ordered.
+template <typename T>
+class ShardedHeap {
+ public:
+  explicit ShardedHeap(std::size_t threads) : shards_(std::max<std::size_t>(threads, 1)) {}
+
+  void Push(T x) {
+    auto& shard = shards_[home()];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    shard.heap.Push(std::move(x));
+  }
+
+  bool TryPop(T& out) {
+    const std::size_t first = home();
+    for (std::size_t i = 0; i < shards_.size(); ++i) {
+      auto& shard = shards_[(first + i) % shards_.size()];
+      std::lock_guard<std::mutex> lock(shard.mutex);
+      if (shard.heap.empty()) continue;
+      out = shard.heap.Pop();
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  // Threads are numbered in the order they first push or pop on any
+  // ShardedHeap, so threads started together get distinct home shards.
+  std::size_t home() {
+    static std::atomic<std::size_t> next_id{0};
+    thread_local const std::size_t id = next_id++;
+    return id % shards_.size();
+  }
+
+  std::vector<LockedShard<T>> shards_;
+};
+
+// Relaxed MultiQueue (Rihani, Sanders and Dementiev): kQueuesPerThread
+// queues per thread. Push goes to a random queue; TryPop locks two random
+// queues and pops the smaller of their tops, so it returns one of the
+// smallest elements with high probability rather than the minimum.
+template <typename T>
+class MultiQueue {
+ public:
+  static constexpr std::size_t kQueuesPerThread = 2;
+
+  explicit MultiQueue(std::size_t threads)
+      : queues_(kQueuesPerThread * std::max<std::size_t>(threads, 1)) {}
+
+  void Push(T x) {
+    while (true) {
+      auto& q = queues_[random_queue()];
+      std::unique_lock<std::mutex> lock(q.mutex, std::try_to_lock);
+      if (!lock) continue;
+      q.heap.Push(std::move(x));
+      size_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+
+  bool TryPop(T& out) {
+    while (size_.load(std::memory_order_relaxed) > 0) {
+      std::size_t i = random_queue(), j = random_queue();
+      if (i == j) continue;
+      if (j < i) std::swap(i, j);
+      std::unique_lock<std::mutex> lock_i(queues_[i].mutex, std::try_to_lock);
+      if (!lock_i) continue;
+      std::unique_lock<std::mutex> lock_j(queues_[j].mutex, std::try_to_lock);
+      if (!lock_j) continue;
+      auto& a = queues_[i].heap;
+      auto& b = queues_[j].heap;
+      if (a.empty() && b.empty()) continue;
+      auto& from = b.empty() || (!a.empty() && !(b.Top() < a.Top())) ? a : b;
+      out = from.Pop();
+      size_.fetch_sub(1, std::memory_order_relaxed);
+      return true;
+    }
+    return false;
+  }
+
+ private:
+  std::size_t random_queue() {
+    thread_local std::minstd_rand rng(
+        static_cast<std::uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id())));
+    return std::uniform_int_distribution<std::size_t>(0, queues_.size() - 1)(rng);
+  }
+
+  std::vector<LockedShard<T>> queues_;
+  std::atomic<std::size_t> size_{0};
+};
+
+template <typename T>
+constexpr std::size_t MultiQueue<T>::kQueuesPerThread;
+
+// Instrumentation policy that records the array slot of every element access,
+// in order, so the trace can be replayed through a CacheSim.
+struct AccessRecorder : NoInstrument {
+  void on_access(std::size_t slot) { trace.push_back(slot); }
+
+  std::vector<std::uint64_t> trace;
+};
+
+// One set-associative cache level with LRU replacement. A TLB is modelled
+// the same way, with the page size as its line size.
+class CacheModel {
+ public:
+  CacheModel(std::size_t bytes, std::size_t ways, std::size_t line)
+      : ways_(std::max<std::size_t>(ways, 1)),
+        line_(line),
+        sets_(std::max<std::size_t>(bytes / (line * ways_), 1)),
+        tags_(sets_ * ways_, kEmpty) {}
+
+  // Looks up the line holding address and returns true on a hit. A miss
+  // fills the line, evicting the least recently used way of its set.
+  bool Access(std::uint64_t address) {
+    const std::uint64_t tag = address / line_;
+    std::uint64_t* const set = &tags_[(tag % sets_) * ways_];
+    ++accesses_;
+    std::size_t way = 0;
+    while (way < ways_ && set[way] != tag) ++way;
+    const bool hit = way < ways_;
+    if (!hit) {
+      ++misses_;
+      way = ways_ - 1;
+    }
+    // Ways are kept most recently used first.
+    std::copy_backward(set, set + way, set + way + 1);
+    set[0] = tag;
+    return hit;
+  }
+
+  std::uint64_t accesses() const { return accesses_; }
+  std::uint64_t misses() const { return misses_; }
+  void ResetCounters() { accesses_ = misses_ = 0; }
+
+ private:
+  static constexpr std::uint64_t kEmpty = ~std::uint64_t{0};
+
+  std::size_t ways_;
+  std::size_t line_;
+  std::size_t sets_;
+  std::vector<std::uint64_t> tags_;
+  std::uint64_t accesses_ = 0;
+  std::uint64_t misses_ = 0;
+};
+
+constexpr std::uint64_t CacheModel::kEmpty;
+
+struct CacheSimConfig {
+  struct Level {
+    std::size_t size;  // bytes for caches, entries for TLBs
+    std::size_t ways;
+  };
+  std::size_t line = 64;
+  std::size_t page = 4096;
+  std::vector<Level> caches;  // L1 first
+  std::vector<Level> tlbs;    // first-level TLB first
+};
+
+// Cache and TLB hierarchy driven by element accesses. Each access touches
+// every line (and page) the element spans; a line goes to the next level only
+// on a miss in the previous one, and likewise for TLBs.
+class CacheSim {
+ public:
+  explicit CacheSim(const CacheSimConfig& config) : line_(config.line), page_(config.page) {
+    for (const auto& c : config.caches) caches_.emplace_back(c.size, c.ways, line_);
+    for (const auto& t : config.tlbs) tlbs_.emplace_back(t.size * page_, t.ways, page_);
+  }
+
+  void Access(std::uint64_t address, std::size_t bytes) {
+    const std::uint64_t last = address + std::max<std::size_t>(bytes, 1) - 1;
+    for (std::uint64_t line = address / line_; line <= last / line_; ++line) {
+      for (auto& c : caches_) {
+        if (c.Access(line * line_)) break;
+      }
+    }
+    for (std::uint64_t page = address / page_; page <= last / page_; ++page) {
+      for (auto& t : tlbs_) {
+        if (t.Access(page * page_)) break;
+      }
+    }
+  }
+
+  // Replays a trace of array slots for elements of element_bytes whose array
+  // starts at base.
+  void Replay(const std::vector<std::uint64_t>& trace, std::size_t element_bytes,
+              std::uint64_t base) {
+    for (const auto slot : trace) Access(base + slot * element_bytes, element_bytes);
+  }
+
+  // Clears the hit and miss counts but keeps the cached lines.
+  void ResetCounters() {
+    for (auto& c : caches_) c.ResetCounters();
+    for (auto& t : tlbs_) t.ResetCounters();
+  }
+
+  const std::vector<CacheModel>& caches() const { return caches_; }
+  const std::vector<CacheModel>& tlbs() const { return tlbs_; }
+
+ private:
+  std::size_t line_;
+  std::size_t page_;
+  std::vector<CacheModel> caches_;
+  std::vector<CacheModel> tlbs_;
+};
+
+// Hardware event counters for the calling thread, read through
+// perf_event_open(2). Each event is opened on its own, so events the kernel,
+// hypervisor or container refuses are simply unavailable while the rest keep
+// counting. Start()/Stop() bracket a window (a benchmark region, or a
+// sampling window in production) and add its counts to totals().
+class PerfCounters {
+ public:
+  enum Event {
+    kCycles,
+    kInstructions,
+    kBranchMisses,
+    kL1dMisses,
+    kLlcMisses,
+    kDtlbMisses,
+    kNumEvents
+  };
+
+  PerfCounters();
+  ~PerfCounters();
+  PerfCounters(const PerfCounters&) = delete;
+  PerfCounters& operator=(const PerfCounters&) = delete;
+
+  static const char* name(Event e) {
+    static const char* const names[kNumEvents] = {
+        "cycles", "instructions", "branch_misses", "l1d_misses", "llc_misses", "dtlb_misses"};
+    return names[e];
+  }
+
+  bool available(Event e) const { return fds_[e] >= 0; }
+  bool any_available() const {
+    return std::any_of(std::begin(fds_), std::end(fds_), [](int fd) { return fd >= 0; });
+  }
+
+  void Start();
+  void Stop();
+  void Reset() { std::fill(std::begin(totals_), std::end(totals_), 0.0); }
+
+  // Accumulated counts, scaled up for time lost to multiplexing; -1 for
+  // unavailable events.
+  std::vector<double> totals() const {
+    std::vector<double> t(std::begin(totals_), std::end(totals_));
+    for (int e = 0; e < kNumEvents; ++e) {
+      if (fds_[e] < 0) t[e] = -1;
+    }
+    return t;
+  }
+
+ private:
+  int fds_[kNumEvents];
+  double totals_[kNumEvents] = {};
+};
+
+#ifdef __linux__
+PerfCounters::PerfCounters() {
+  auto cache = [](std::uint64_t id, std::uint64_t result) {
+    return id | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (result << 16);
+  };
+  const std::uint32_t types[kNumEvents] = {PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE,
+                                           PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+                                           PERF_TYPE_HW_CACHE, PERF_TYPE_HW_CACHE};
+  const std::uint64_t configs[kNumEvents] = {
+      PERF_COUNT_HW_CPU_CYCLES,
+      PERF_COUNT_HW_INSTRUCTIONS,
+      PERF_COUNT_HW_BRANCH_MISSES,
+      cache(PERF_COUNT_HW_CACHE_L1D, PERF_COUNT_HW_CACHE_RESULT_MISS),
+      cache(PERF_COUNT_HW_CACHE_LL, PERF_COUNT_HW_CACHE_RESULT_MISS),
+      cache(PERF_COUNT_HW_CACHE_DTLB, PERF_COUNT_HW_CACHE_RESULT_MISS)};
+  for (int e = 0; e < kNumEvents; ++e) {
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = types[e];
+    attr.config = configs[e];
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+    fds_[e] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+  }
+}
+
+PerfCounters::~PerfCounters() {
+  for (const int fd : fds_) {
+    if (fd >= 0) close(fd);
+  }
+}
+
+void PerfCounters::Start() {
+  for (const int fd : fds_) {
+    if (fd < 0) continue;
+    ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+    ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  }
+}
+
+void PerfCounters::Stop() {
+  for (const int fd : fds_) {
+    if (fd >= 0) ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+  }
+  for (int e = 0; e < kNumEvents; ++e) {
+    std::uint64_t value[3];  // count, time enabled, time running
+    if (fds_[e] < 0 || read(fds_[e], value, sizeof(value)) != sizeof(value)) continue;
+    totals_[e] += value[2] ? value[0] * (static_cast<double>(value[1]) / value[2]) : 0;
+  }
+}
+#else
+PerfCounters::PerfCounters() { std::fill(std::begin(fds_), std::end(fds_), -1); }
+PerfCounters::~PerfCounters() {}
+void PerfCounters::Start() {}
+void PerfCounters::Stop() {}
+#endif
+
+//
+// Benchmark driver
+//
+
+// Keeps the optimizer from discarding a benchmarked result.
+template <typename T>
+inline void escape(const T& value) {
+  asm volatile("" : : "r"(&value) : "memory");
+}
+
+// Adapters giving every benchmarked layout the same Build/Empty/Push/Pop
+// surface. input_type is what Build() consumes; it is prepared outside the
+// timed region.
+template <typename T, typename Index, typename Instrument = NoInstrument>
+struct HeapLayout {
+  using value_type = T;
+  using heap_type = Heap<T, Index, Instrument>;
+  using input_type = std::vector<T>;
+  static constexpr bool kHasOffset = true;
+  static constexpr bool kHasUpdate = true;
+
+  static input_type Prepare(const std::vector<T>& v) { return v; }
+  static heap_type Build(const input_type& in, std::size_t offset) {
+    return heap_type(in, offset);
+  }
+  static heap_type Empty(std::size_t capacity, std::size_t offset) {
+    heap_type h(std::vector<T>(), offset);
+    h.reserve(capacity);
+    return h;
+  }
+  static void Push(heap_type& h, const T& x) { h.Push(x); }
+  static T Pop(heap_type& h) { return h.Pop(); }
+  static T At(const heap_type& h, std::size_t pos) {
+    return h.At(static_cast<Index>(pos));
+  }
+  static void Update(heap_type& h, std::size_t pos, const T& x) {
+    h.Update(static_cast<Index>(pos), x);
+  }
+  static void Meld(heap_type& h, heap_type& other) { h.Meld(other); }
+  static HeapStats Stats(const heap_type& h, std::size_t line) { return h.Stats(line); }
+};
+
+// Single-column LexHeap: the same binary heap on a cache-line-aligned array.
+template <typename T>
+struct AlignedLayout {
+  using value_type = T;
+  using heap_type = CompactLexHeap<T>;
+  using input_type = std::vector<std::tuple<T>>;
+  static constexpr bool kHasOffset = true;
+  static constexpr bool kHasUpdate = true;
+
+  static input_type Prepare(const std::vector<T>& v) {
+    return input_type(v.begin(), v.end());
+  }
+  static heap_type Build(const input_type& in, std::size_t offset) {
+    return heap_type(in, offset);
+  }
+  static heap_type Empty(std::size_t capacity, std::size_t offset) {
+    return heap_type(capacity, offset);
+  }
+  static void Push(heap_type& h, const T& x) { h.Push(x); }
+  static T Pop(heap_type& h) { return std::get<0>(h.Pop()); }
+  static T At(const heap_type& h, std::size_t pos) {
+    return std::get<0>(h.At(static_cast<std::uint32_t>(pos)));
+  }
+  static void Update(heap_type& h, std::size_t pos, const T& x) {
+    h.Update(static_cast<std::uint32_t>(pos), std::tuple<T>(x));
+  }
+  static void Meld(heap_type& h, heap_type& other) { h.Meld(other); }
+  static HeapStats Stats(const heap_type& h, std::size_t line) { return h.Stats(line); }
+};
+
+// AgingHeap with the global map left at the identity: the cost of the
+// wrapper's read and write transforms.
+template <typename T>
+struct AgingLayout {
+  using value_type = T;
+  using heap_type = AgingHeap<T>;
+  using input_type = std::vector<T>;
+  static constexpr bool kHasOffset = true;
+  static constexpr bool kHasUpdate = false;
+
+  static input_type Prepare(const std::vector<T>& v) { return v; }
+  static heap_type Build(const input_type& in, std::size_t offset) {
+    return heap_type(in, offset);
+  }
+  static heap_type Empty(std::size_t, std::size_t offset) {
+    heap_type h;
+    h.set_offset(offset);
+    return h;
+  }
+  static void Push(heap_type& h, const T& x) { h.Push(x); }
+  static T Pop(heap_type& h) { return h.Pop(); }
+  static T At(const heap_type&, std::size_t) {
+    throw std::logic_error("AgingHeap has no positional access");
+  }
+  static void Update(heap_type&, std::size_t, const T&) {
+    throw std::logic_error("AgingHeap has no decrease-key");
+  }
+  static void Meld(heap_type& h, heap_type& other) { h.Meld(other); }
+  static HeapStats Stats(const heap_type& h, std::size_t line) { return h.Stats(line); }
+};
+
+// Baseline: std::priority_queue as a min-heap. It has no offset and no
+// decrease-key.
+template <typename T>
+struct StdPriorityQueueLayout {
+  using value_type = T;
+  using heap_type = std::priority_queue<T, std::vector<T>, std::greater<T>>;
+  using input_type = std::vector<T>;
+  static constexpr bool kHasOffset = false;
+  static constexpr bool kHasUpdate = false;
+
+  // The container is a protected member; a derived class may name it.
+  struct Access : heap_type {
+    static const std::vector<T>& container(const heap_type& q) { return q.*&Access::c; }
+  };
+
+  static input_type Prepare(const std::vector<T>& v) { return v; }
+  static heap_type Build(const input_type& in, std::size_t) {
+    return heap_type(std::greater<T>(), in);
+  }
+  static heap_type Empty(std::size_t capacity, std::size_t) {
+    std::vector<T> c;
+    c.reserve(capacity);
+    return heap_type(std::greater<T>(), std::move(c));
+  }
+  static void Push(heap_type& h, const T& x) { h.push(x); }
+  static T Pop(heap_type& h) {
+    T top = h.top();
+    h.pop();
+    return top;
+  }
+  static T At(const heap_type&, std::size_t) {
+    throw std::logic_error("std::priority_queue has no positional access");
+  }
+  static void Update(heap_type&, std::size_t, const T&) {
+    throw std::logic_error("std::priority_queue has no decrease-key");
+  }
+  static void Meld(heap_type& h, heap_type& other) {
+    for (const auto& x : Access::container(other)) h.push(x);
+    other = heap_type();
+  }
+  static HeapStats Stats(const heap_type& h, std::size_t line) {
+    const auto& c = Access::container(h);
+    return heap_stats(c.data(), sizeof(T), c.size(), c.capacity(), 0,
+                      c.capacity() * sizeof(T), line);
+  }
+};
+
+// Baseline: std::make_heap/push_heap/pop_heap on a std::vector, as a
+// min-heap. Decrease-key works because every prefix of a heap is a heap:
+// lowering the key at pos and calling push_heap on [0, pos] sifts it up.
+template <typename T>
+struct StdHeapLayout {
+  using value_type = T;
+  using heap_type = std::vector<T>;
+  using input_type = std::vector<T>;
+  static constexpr bool kHasOffset = false;
+  static constexpr bool kHasUpdate = true;
+
+  static input_type Prepare(const std::vector<T>& v) { return v; }
+  static heap_type Build(const input_type& in, std::size_t) {
+    heap_type h(in);
+    std::make_heap(h.begin(), h.end(), std::greater<T>());
+    return h;
+  }
+  static heap_type Empty(std::size_t capacity, std::size_t) {
+    heap_type h;
+    h.reserve(capacity);
+    return h;
+  }
+  static void Push(heap_type& h, const T& x) {
+    h.push_back(x);
+    std::push_heap(h.begin(), h.end(), std::greater<T>());
+  }
+  static T Pop(heap_type& h) {
+    std::pop_heap(h.begin(), h.end(), std::greater<T>());
+    T top = h.back();
+    h.pop_back();
+    return top;
+  }
+  static T At(const heap_type& h, std::size_t pos) { return h[pos]; }
+  static void Update(heap_type& h, std::size_t pos, const T& x) {
+    if (h[pos] < x) throw std::logic_error("std heap baseline only decreases keys");
+    h[pos] = x;
+    std::push_heap(h.begin(), h.begin() + pos + 1, std::greater<T>());
+  }
+  static void Meld(heap_type& h, heap_type& other) {
+    for (const auto& x : other) Push(h, x);
+    other.clear();
+  }
+  static HeapStats Stats(const heap_type& h, std::size_t line) {
+    return heap_stats(h.data(), sizeof(T), h.size(), h.capacity(), 0,
+                      h.capacity() * sizeof(T), line);
+  }
+};
+
+// PairingHeap on pooled nodes. There is no array, so no offset, and
+// decrease-key goes through the handles Push returns rather than the
+// positions the mixes pick.
+template <typename T>
+struct PairingLayout {
+  using value_type = T;
+  using heap_type = PairingHeap<T>;
+  using input_type = std::vector<T>;
+  using handle_type = typename heap_type::handle_type;
+  static constexpr bool kHasOffset = false;
+  static constexpr bool kHasUpdate = false;
+
+  static input_type Prepare(const std::vector<T>& v) { return v; }
+  static heap_type Build(const input_type& in, std::size_t) { return heap_type(in); }
+  static heap_type Empty(std::size_t capacity, std::size_t) { return heap_type(capacity); }
+  static handle_type Push(heap_type& h, const T& x) { return h.Push(x); }
+  static T Pop(heap_type& h) { return h.Pop(); }
+  static T At(const heap_type&, std::size_t) {
+    throw std::logic_error("PairingHeap has no positional access");
+  }
+  static void Update(heap_type&, std::size_t, const T&) {
+    throw std::logic_error("PairingHeap decreases keys by handle, not position");
+  }
+  static void Decrease(heap_type& h, handle_type e, const T& x) { h.Update(e, x); }
+  static void Meld(heap_type& h, heap_type& other) { h.Meld(other); }
+  static HeapStats Stats(const heap_type& h, std::size_t line) { return h.Stats(line); }
+};
+
+// Benchmark element of Size bytes: the 64-bit key the heap orders by,
+// followed by padding that stands in for a payload. Trivial, so it also
+// works in the aligned layout; arithmetic with a double shifts the key.
+template <std::size_t Size>
+struct Record {
+  static_assert(Size > sizeof(std::int64_t), "Record needs room for a payload");
+
+  Record() = default;
+  explicit Record(double k) : key(static_cast<std::int64_t>(k)), payload() {}
+
+  bool operator<(const Record& other) const { return key < other.key; }
+  bool operator>(const Record& other) const { return key > other.key; }
+  Record operator+(double d) const { return Record(key + d); }
+  Record operator-(double d) const { return Record(key - d); }
+
+  std::int64_t key;
+  unsigned char payload[Size - sizeof(std::int64_t)];
+};
+
+template <std::size_t Size>
+std::ostream& operator<<(std::ostream& os, const Record<Size>& r) {
+  return os << r.key;
+}
+
+//
+// Workload generators
+//
+
+// Returns n keys in the named order. Keys are generated as integers in
+// [0, n] and cast to T, straight into the result so that inputs near memory
+// size don't need a second copy.
+template <typename T>
+std::vector<T> make_input(const std::string& kind, std::size_t n, std::uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::vector<T> keys(n);
+  if (kind == "reverse") {
+    // Every element has to travel to the bottom.
+    for (std::size_t i = 0; i < n; ++i) keys[i] = static_cast<T>(n - i);
+  } else if (kind == "sorted") {
+    for (std::size_t i = 0; i < n; ++i) keys[i] = static_cast<T>(i + 1);
+  } else if (kind == "uniform") {
+    std::uniform_int_distribution<std::uint64_t> dist(0, n);
+    for (auto& k : keys) k = static_cast<T>(dist(rng));
+  } else if (kind == "few-distinct") {
+    std::uniform_int_distribution<int> dist(0, 15);
+    for (auto& k : keys) k = static_cast<T>(dist(rng));
+  } else if (kind == "zipf") {
+    // Zipf(1) over ranks 1..n, approximated by inverting the continuous CDF
+    // ln(k) / ln(n + 1): rank k comes up roughly in proportion to 1 / k.
+    std::uniform_real_distribution<double> u(0, 1);
+    const double log_n = std::log(static_cast<double>(n) + 1);
+    for (auto& k : keys) k = static_cast<T>(std::floor(std::exp(u(rng) * log_n)));
+  } else if (kind == "sawtooth") {
+    // Ascending runs of about sqrt(n) keys.
+    const auto period = std::max<std::size_t>(1, static_cast<std::size_t>(std::sqrt(n)));
+    for (std::size_t i = 0; i < n; ++i) keys[i] = static_cast<T>(i % period);
+  } else if (kind == "adversarial") {
+    // Reverse-sorted with each sibling pair swapped on a coin flip: every
+    // element still sifts to the bottom, but which child is smaller is
+    // random at every level, so the branch predictor can't learn it.
+    std::bernoulli_distribution coin(0.5);
+    for (std::size_t i = 0; i < n; ++i) keys[i] = static_cast<T>(n - i);
+    for (std::size_t i = 1; i + 1 < n; i += 2) {
+      if (coin(rng)) std::swap(keys[i], keys[i + 1]);
+    }
+  } else {
+    throw std::invalid_argument("unknown input: " + kind);
+  }
+  return keys;
+}
+
+// One step of an operation mix, replayed against a heap built from the input.
+enum class MixOp : std::uint8_t {
+  kPush,          // push value
+  kPop,           // pop the top
+  kPushAfterPop,  // push the last popped key plus value
+  kDecrease,      // lower the key at position pos by value
+};
+
+struct MixStep {
+  MixOp op;
+  std::uint32_t pos;
+  double value;
+};
+
+// Mixes run steps against a built heap; replay runs a --trace on an empty one.
+bool is_mix(const std::string& op) {
+  return op == "hold" || op == "insert-heavy" || op == "pop-heavy" ||
+         op == "decrease-key" || op == "dijkstra" || op == "replay";
+}
+
+bool has_updates(const std::vector<MixStep>& steps) {
+  return std::any_of(steps.begin(), steps.end(),
+                     [](const MixStep& s) { return s.op == MixOp::kDecrease; });
+}
+
+// Largest heap size reached by running steps on a heap of initial elements.
+std::size_t peak_size(const std::vector<MixStep>& steps, std::size_t initial) {
+  std::size_t size = initial, peak = initial;
+  for (const auto& s : steps) {
+    if (s.op == MixOp::kPop) {
+      --size;
+    } else if (s.op != MixOp::kDecrease) {
+      peak = std::max(peak, ++size);
+    }
+  }
+  return peak;
+}
+
+// Reads a binary operation trace (see TraceWriter) as replay steps. Throws
+// std::runtime_error if the file can't be read or isn't a valid trace.
+std::vector<MixStep> load_trace(const std::string& path) {
+  std::ifstream in(path, std::ios::binary);
+  if (!in) throw std::runtime_error("can't open trace " + path);
+  TraceReader reader(in);
+  std::vector<MixStep> steps;
+  std::size_t size = 0;
+  TraceRecord r;
+  while (reader.Next(r)) {
+    switch (r.op) {
+      case TraceOp::kPush:
+        steps.push_back({MixOp::kPush, 0, r.value});
+        ++size;
+        break;
+      case TraceOp::kPop:
+        if (size == 0) throw std::runtime_error("trace pops an empty heap: " + path);
+        steps.push_back({MixOp::kPop, 0, 0});
+        --size;
+        break;
+      case TraceOp::kUpdate:
+        if (r.pos >= size) throw std::runtime_error("trace updates past the end: " + path);
+        steps.push_back({MixOp::kDecrease, static_cast<std::uint32_t>(r.pos), r.value});
+        break;
+    }
+  }
+  return steps;
+}
+
+// Generates n steps of the named mix for a heap that starts with n elements.
+// Increments and weights are uniform in [0, n); positions are uniform over
+// the heap's size at that step.
+std::vector<MixStep> make_mix(const std::string& mix, std::size_t n, std::uint64_t seed) {
+  std::mt19937_64 rng(seed);
+  std::uniform_real_distribution<double> u(0, 1);
+  std::uniform_real_distribution<double> increment(0, static_cast<double>(n));
+  std::size_t size = n;
+  std::vector<MixStep> steps;
+  steps.reserve(n);
+  auto push = [&](MixOp op) {
+    steps.push_back({op, 0, std::floor(increment(rng))});
+    ++size;
+  };
+  auto pop = [&] {
+    steps.push_back({MixOp::kPop, 0, 0});
+    --size;
+  };
+  auto decrease = [&] {
+    std::uniform_int_distribution<std::size_t> pos(0, size - 1);
+    steps.push_back({MixOp::kDecrease, static_cast<std::uint32_t>(pos(rng)),
+                     std::floor(increment(rng) / 4)});
+  };
+  while (steps.size() < n) {
+    const double r = u(rng);
+    if (mix == "hold") {
+      // Pop the minimum, push it back later by a random increment.
+      pop();
+      push(MixOp::kPushAfterPop);
+    } else if (mix == "insert-heavy") {
+      if (r < 0.75 || size == 0) push(MixOp::kPush); else pop();
+    } else if (mix == "pop-heavy") {
+      if (r < 0.25 || size == 0) push(MixOp::kPush); else pop();
+    } else if (mix == "decrease-key") {
+      if (size == 0 || r < 0.25) {
+        push(MixOp::kPush);
+      } else if (r < 0.5) {
+        pop();
+      } else {
+        decrease();
+      }
+    } else if (mix == "dijkstra") {
+      // Settle the closest vertex, relax its edges: two new tentative
+      // distances on average and a decrease-key every other step.
+      if (size == 0) {
+        push(MixOp::kPush);
+        continue;
+      }
+      pop();
+      const int relaxed = std::uniform_int_distribution<int>(0, 4)(rng);
+      for (int i = 0; i < relaxed; ++i) push(MixOp::kPushAfterPop);
+      if (size > 0 && r < 0.5) decrease();
+    } else {
+      throw std::invalid_argument("unknown operation mix: " + mix);
+    }
+  }
+  steps.resize(n);
+  return steps;
+}
+
+// Runs a mix against h; returns the last popped key so the work isn't elided.
+template <typename L>
+typename L::value_type run_mix(typename L::heap_type& h, const std::vector<MixStep>& steps) {
+  using T = typename L::value_type;
+  T last = T();
+  for (const auto& s : steps) {
+    switch (s.op) {
+      case MixOp::kPush:
+        L::Push(h, static_cast<T>(s.value));
+        break;
+      case MixOp::kPop:
+        last = L::Pop(h);
+        break;
+      case MixOp::kPushAfterPop:
+        L::Push(h, static_cast<T>(last + s.value));
+        break;
+      case MixOp::kDecrease:
+        L::Update(h, s.pos, static_cast<T>(L::At(h, s.pos) - s.value));
+        break;
+    }
+  }
+  return last;
+}
+
+// Input keys for a benchmark and, for mixes, the steps replayed on them.
+template <typename T>
+struct Workload {
+  std::vector<T> values;
+  std::vector<MixStep> steps;
+};
+
+// Robust summary of per-run times, in seconds.
+struct Summary {
+  std::size_t n = 0;         // samples kept
+  std::size_t outliers = 0;  // samples rejected as outliers
+  double mean = 0;
+  double median = 0;
+  double p90 = 0;
+  double p99 = 0;
+  double stddev = 0;
+  double ci_low = 0;  // bootstrap 95% confidence interval of the median
+  double ci_high = 0;
+};
+
+// Linearly interpolated percentile of sorted samples, p in [0, 1].
+double percentile(const std::vector<double>& sorted, double p) {
+  if (sorted.empty()) return 0;
+  const double rank = p * (sorted.size() - 1);
+  const auto lo = static_cast<std::size_t>(rank);
+  const auto hi = std::min(lo + 1, sorted.size() - 1);
+  return sorted[lo] + (rank - lo) * (sorted[hi] - sorted[lo]);
+}
+
+double median(std::vector<double> v) {
+  std::sort(v.begin(), v.end());
+  return percentile(v, 0.5);
+}
+
+// Samples beyond Q3 + kOutlierFence * IQR (or below Q1 - kOutlierFence * IQR)
+// are rejected: Tukey's "far out" fence, which keeps the ordinary right skew
+// of timings and drops interrupts and page-fault storms.
+constexpr double kOutlierFence = 3.0;
+
+Summary summarize(std::vector<double> samples, std::size_t resamples) {
+  Summary s;
+  if (samples.empty()) return s;
+  std::sort(samples.begin(), samples.end());
+  const double q1 = percentile(samples, 0.25);
+  const double q3 = percentile(samples, 0.75);
+  const double lo = q1 - kOutlierFence * (q3 - q1);
+  const double hi = q3 + kOutlierFence * (q3 - q1);
+  std::vector<double> kept;
+  for (const auto x : samples) {
+    if (x >= lo && x <= hi) kept.push_back(x);
+  }
+  s.n = kept.size();
+  s.outliers = samples.size() - kept.size();
+  s.mean = std::accumulate(kept.begin(), kept.end(), 0.0) / s.n;
+  double sq = 0;
+  for (const auto x : kept) sq += (x - s.mean) * (x - s.mean);
+  s.stddev = s.n > 1 ? std::sqrt(sq / (s.n - 1)) : 0;
+  s.median = percentile(kept, 0.5);
+  s.p90 = percentile(kept, 0.9);
+  s.p99 = percentile(kept, 0.99);
+
+  // Percentile bootstrap with a fixed seed, so reruns report the same CI.
+  std::mt19937_64 rng(0x5eed);
+  std::uniform_int_distribution<std::size_t> pick(0, s.n - 1);
+  std::vector<double> medians(resamples);
+  std::vector<double> resample(s.n);
+  for (auto& m : medians) {
+    for (auto& x : resample) x = kept[pick(rng)];
+    m = median(resample);
+  }
+  std::sort(medians.begin(), medians.end());
+  s.ci_low = resamples ? percentile(medians, 0.025) : s.median;
+  s.ci_high = resamples ? percentile(medians, 0.975) : s.median;
+  return s;
+}
+
+//
+// Host description
+//
+
+struct CacheLevel {
+  int level;
+  std::size_t bytes;
+  std::size_t ways;  // 0 if unknown
+  std::size_t line;  // 0 if unknown
+};
+
+// Parses sysfs sizes such as "48K" or "2048K".
+std::size_t parse_cache_size(const std::string& s) {
+  std::size_t pos = 0;
+  std::size_t n = std::stoull(s, &pos);
+  if (pos < s.size() && (s[pos] == 'K' || s[pos] == 'k')) n <<= 10;
+  if (pos < s.size() && (s[pos] == 'M' || s[pos] == 'm')) n <<= 20;
+  return n;
+}
+
+// Data and unified caches of cpu0, smallest level first. Reads sysfs and
+// falls back to glibc's sysconf names where sysfs isn't mounted.
+std::vector<CacheLevel> detect_caches() {
+  std::vector<CacheLevel> caches;
+  for (int i = 0;; ++i) {
+    const std::string dir = "/sys/devices/system/cpu/cpu0/cache/index" + std::to_string(i);
+    std::ifstream level_file(dir + "/level");
+    std::ifstream type_file(dir + "/type");
+    std::ifstream size_file(dir + "/size");
+    if (!level_file || !type_file || !size_file) break;
+    std::ifstream ways_file(dir + "/ways_of_associativity");
+    std::ifstream line_file(dir + "/coherency_line_size");
+    int level = 0;
+    std::string type, size;
+    std::size_t ways = 0, line = 0;
+    level_file >> level;
+    type_file >> type;
+    size_file >> size;
+    ways_file >> ways;
+    line_file >> line;
+    if (type == "Instruction" || size.empty()) continue;
+    caches.push_back({level, parse_cache_size(size), ways, line});
+  }
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+  if (caches.empty()) {
+    const long sizes[] = {sysconf(_SC_LEVEL1_DCACHE_SIZE), sysconf(_SC_LEVEL2_CACHE_SIZE),
+                          sysconf(_SC_LEVEL3_CACHE_SIZE)};
+    for (int i = 0; i < 3; ++i) {
+      if (sizes[i] > 0) caches.push_back({i + 1, static_cast<std::size_t>(sizes[i]), 0, 0});
+    }
+  }
+#endif
+  std::sort(caches.begin(), caches.end(),
+            [](const CacheLevel& a, const CacheLevel& b) { return a.level < b.level; });
+  return caches;
+}
+
+// Name of the smallest cache level that holds bytes, or "DRAM".
+std::string fitting_level(std::size_t bytes, const std::vector<CacheLevel>& caches) {
+  for (const auto& c : caches) {
+    if (bytes <= c.bytes) return "L" + std::to_string(c.level);
+  }
+  return "DRAM";
+}
+
+// Formats a byte count with a binary unit, e.g. "48 KiB".
+std::string format_bytes(std::size_t bytes) {
+  const char* units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+  int u = 0;
+  double v = static_cast<double>(bytes);
+  while (v >= 1024 && u < 4) {
+    v /= 1024;
+    ++u;
+  }
+  std::ostringstream os;
+  os << std::setprecision(v < 10 ? 2 : 3) << v << ' ' << units[u];
+  return os.str();
+}
+
+std::string describe_caches(const std::vector<CacheLevel>& caches) {
+  if (caches.empty()) return "cache sizes unknown";
+  std::string s;
+  for (const auto& c : caches) {
+    if (!s.empty()) s += ", ";
+    s += "L" + std::to_string(c.level) + " " + format_bytes(c.bytes);
+  }
+  return s;
+}
+
+struct BenchOptions {
+  std::vector<std::string> types = {"float"};
+  std::vector<std::size_t> sizes = {5000};
+  std::vector<std::size_t> offsets = {0, 1, 2, 3, 4, 5, 6, 7, 8, 9};
+  std::vector<std::size_t> arities = {2};
+  std::vector<std::string> layouts = {"heap", "compact", "aligned", "aging",
+                                      "std-pq", "std-heap", "pairing"};
+  std::string baseline = "std-pq";  // layout the others are compared to
+  std::vector<std::string> ops = {"build"};
+  std::vector<std::string> inputs = {"reverse"};
+  std::vector<std::size_t> threads = {1};
+  std::size_t trials = 50;
+  std::size_t warmup = 50;    // upper bound on warmup runs
+  double min_time = 1e-3;     // seconds; shorter runs are timed in batches
+  std::size_t bootstrap = 1000;
+  std::uint64_t seed = 1;
+  std::string format = "text";
+  bool counters = false;  // hardware counters around timed regions
+  std::vector<CacheLevel> caches = detect_caches();
+  bool work = false;          // count compares, moves, levels, allocations
+  bool latency = false;       // per-operation latency percentiles
+  bool depths = false;        // sift depth distributions
+  std::uint32_t depth_period = 1;  // sample one operation in this many
+  bool hold_model = false;     // run the hold-model benchmark instead
+  bool stats = false;          // report each layout's Stats() instead
+  bool model = false;          // report the analytic layout model instead
+  std::string publish_metrics;  // shared-memory object to publish a live heap to
+  std::string read_metrics;     // shared-memory object to read metrics from
+  std::vector<std::string> increments = {"exponential", "uniform", "bimodal", "triangular"};
+  std::vector<std::string> frontends;  // non-empty runs the scaling benchmark
+  std::vector<std::string> graphs;     // non-empty runs the graph-search benchmark
+  std::vector<std::string> algorithms = {"dijkstra", "astar", "prim"};
+  std::vector<std::string> placements = {"none"};
+  double duration = 0.2;       // seconds per scaling run
+  std::vector<MixStep> trace;  // --trace steps for the replay op
+  std::string record_trace;    // --record-trace output file
+  std::string save_baseline;   // baseline store to save results to
+  std::string compare;         // baseline store to compare results with
+  double alpha = 0.01;         // significance level of a regression
+  double threshold = 0.05;     // smallest mean slowdown that is a regression
+  bool simulate = false;      // replay access traces instead of timing
+  std::size_t sim_base = 16;  // simulated array address, as malloc aligns it
+  CacheSimConfig sim;
+};
+
+struct BenchResult {
+  std::string type;
+  std::string layout;
+  std::string op;
+  std::string input;
+  std::size_t arity;
+  std::size_t size;
+  std::size_t offset;
+  std::size_t threads;
+  std::vector<double> samples;  // seconds per run
+  std::size_t ops_per_run = 1;  // 1 for build, size for everything else
+  std::size_t element_bytes = 0;
+  std::size_t bytes = 0;        // heap array footprint, offset included
+  std::string fits;             // smallest cache level holding the heap
+  std::size_t batch = 1;        // runs timed together per sample
+  Summary summary;
+  double relative = 1;       // median over the median at the first offset
+  bool within_noise = true;  // CI overlaps the first offset's CI
+  double vs_baseline = 0;    // baseline median over this median; 0 if none
+  std::vector<double> counters;  // PerfCounters events per element, -1 if
+                                 // unavailable; empty without --counters
+  std::vector<double> work;         // per element: compares, moves, levels,
+                                    // allocations; empty without --work
+  std::vector<double> latency;      // ns per Heap operation: p50, p99, p99.9,
+                                    // max; empty without --latency
+  std::vector<DepthHistogram> depths;  // sift depths per HeapOp; empty
+                                       // without --depths
+  double sim_accesses = 0;          // element accesses per element
+  std::vector<double> sim_misses;   // per element: caches, then TLBs;
+                                    // empty without --simulate
+};
+
+// Warmup stops once the medians of two consecutive windows of this many runs
+// agree within kWarmupTolerance.
+// Warmup also ends after kMaxWarmupSeconds, so that DRAM-sized heaps get a
+// run or two rather than a full window.
+constexpr std::size_t kWarmupWindow = 5;
+constexpr double kWarmupTolerance = 0.02;
+constexpr double kMaxWarmupSeconds = 1.0;
+constexpr std::size_t kMaxBatch = 1 << 20;
+// --latency stops repeating a run once this many operations are recorded.
+constexpr std::uint64_t kMinLatencySamples = 100000;
+// The meld op merges heaps of this many elements.
+constexpr std::size_t kMeldPart = 64;
+
+// The workload cut into heaps of kMeldPart elements for the meld op, each
+// built on its own like queues that grew apart; at least one, maybe empty.
+template <typename L>
+std::vector<typename L::heap_type> meld_parts(const std::vector<typename L::value_type>& values,
+                                              std::size_t offset) {
+  std::vector<typename L::heap_type> parts;
+  for (std::size_t i = 0; i < values.size(); i += kMeldPart) {
+    const std::vector<typename L::value_type> part(
+        values.begin() + i, values.begin() + std::min(i + kMeldPart, values.size()));
+    parts.push_back(L::Build(L::Prepare(part), offset));
+  }
+  if (parts.empty()) parts.push_back(L::Empty(0, offset));
+  return parts;
+}
+
+// Times batch back-to-back runs of op over the workload, each on its own
+// heap (for meld, its own meld_parts()), and returns the total seconds. in is w.values prepared for
+// L::Build(). Heaps are set up before and destroyed after the timed region.
+// counters, if given, count over the same region.
+template <typename L>
+double time_op(const std::string& op, const Workload<typename L::value_type>& w,
+               const typename L::input_type& in, std::size_t offset,
+               std::size_t batch, PerfCounters* counters = nullptr) {
+  using steady_clock = std::chrono::steady_clock;
+  std::vector<typename L::heap_type> heaps;
+  heaps.reserve(batch);
+  steady_clock::time_point start, stop;
+  auto begin = [&] {
+    if (counters) counters->Start();
+    start = steady_clock::now();
+  };
+  auto end = [&] {
+    stop = steady_clock::now();
+    if (counters) counters->Stop();
+  };
+  if (op == "build") {
+    begin();
+    for (std::size_t k = 0; k < batch; ++k) heaps.push_back(L::Build(in, offset));
+    escape(heaps);
+    end();
+  } else if (op == "push") {
+    for (std::size_t k = 0; k < batch; ++k) {
+      heaps.push_back(L::Empty(w.values.size(), offset));
+    }
+    begin();
+    for (auto& h : heaps) {
+      for (const auto& x : w.values) L::Push(h, x);
+    }
+    escape(heaps);
+    end();
+  } else if (op == "pop") {
+    for (std::size_t k = 0; k < batch; ++k) heaps.push_back(L::Build(in, offset));
+    begin();
+    for (auto& h : heaps) {
+      while (!h.empty()) escape(L::Pop(h));
+    }
+    end();
+  } else if (is_mix(op)) {
+    for (std::size_t k = 0; k < batch; ++k) heaps.push_back(L::Build(in, offset));
+    begin();
+    for (auto& h : heaps) escape(run_mix<L>(h, w.steps));
+    end();
+  } else if (op == "meld") {
+    std::vector<std::vector<typename L::heap_type>> parts;
+    for (std::size_t k = 0; k < batch; ++k) parts.push_back(meld_parts<L>(w.values, offset));
+    begin();
+    for (auto& p : parts) {
+      for (std::size_t i = 1; i < p.size(); ++i) L::Meld(p.front(), p[i]);
+    }
+    escape(parts);
+    end();
+  } else {
+    throw std::invalid_argument("unknown operation: " + op);
+  }
+  return std::chrono::duration<double>(stop - start).count();
+}
+
+// Runs single runs until timings settle (or max_runs is reached) and returns
+// the last window's median run time.
+template <typename Run>
+double warm_up(Run run, std::size_t max_runs) {
+  std::vector<double> window;
+  double previous = -1;
+  double current = run();
+  double spent = current;
+  for (std::size_t i = 1; i < max_runs && spent < kMaxWarmupSeconds; ++i) {
+    window.push_back(run());
+    spent += window.back();
+    if (window.size() < kWarmupWindow) continue;
+    current = median(window);
+    window.clear();
+    if (previous >= 0 && std::abs(current - previous) <= kWarmupTolerance * previous) {
+      break;
+    }
+    previous = current;
+  }
+  return current;
+}
+
+// Warms up, sizes batches so each sample lasts at least opt.min_time, and
+// collects opt.trials samples per thread, each thread on its own heaps. Fills
+// r.samples with per-run times pooled across threads, r.batch with thread 0's
+// batch and, with --counters, r.counters with events per element.
+template <typename L>
+void sample_op(const Workload<typename L::value_type>& w, const BenchOptions& opt,
+               BenchResult& r) {
+  std::vector<std::vector<double>> per_thread(r.threads);
+  std::vector<std::size_t> batches(r.threads, 1);
+  std::vector<std::vector<double>> counts(r.threads);
+  auto work = [&](std::size_t t) {
+    const auto in = L::Prepare(w.values);
+    const double estimate =
+        warm_up([&] { return time_op<L>(r.op, w, in, r.offset, 1); }, opt.warmup);
+    const auto b = estimate > 0 ? std::ceil(opt.min_time / estimate) : kMaxBatch;
+    batches[t] = static_cast<std::size_t>(std::min<double>(std::max(b, 1.0), kMaxBatch));
+    std::unique_ptr<PerfCounters> counters;
+    if (opt.counters) counters = std::make_unique<PerfCounters>();
+    for (std::size_t i = 0; i < opt.trials; ++i) {
+      const double seconds = time_op<L>(r.op, w, in, r.offset, batches[t], counters.get());
+      per_thread[t].push_back(seconds / batches[t]);
+    }
+    if (counters) counts[t] = counters->totals();
+  };
+  if (r.threads == 1) {
+    work(0);
+  } else {
+    std::vector<std::thread> pool;
+    for (std::size_t t = 0; t < r.threads; ++t) pool.emplace_back(work, t);
+    for (auto& th : pool) th.join();
+  }
+  r.batch = batches[0];
+  for (const auto& s : per_thread) r.samples.insert(r.samples.end(), s.begin(), s.end());
+  if (!opt.counters) return;
+  r.counters.assign(PerfCounters::kNumEvents, 0);
+  double elements = 0;
+  for (std::size_t t = 0; t < r.threads; ++t) {
+    elements += static_cast<double>(opt.trials) * batches[t] * r.size;
+    for (int e = 0; e < PerfCounters::kNumEvents; ++e) {
+      if (counts[t][e] < 0) r.counters[e] = -1;
+      if (r.counters[e] >= 0) r.counters[e] += counts[t][e];
+    }
+  }
+  for (auto& c : r.counters) {
+    if (c >= 0) c /= elements;
+  }
+}
+
+// Layouts whose heap records an access trace for --simulate.
+template <typename L>
+struct Traced : std::false_type {};
+
+template <typename T, typename Index>
+struct Traced<HeapLayout<T, Index, AccessRecorder>> : std::true_type {};
+
+// The heap a single untimed run of op starts from: empty with room for the
+// workload for push, otherwise built from it (for build, that is the run).
+template <typename L>
+typename L::heap_type setup_op(const std::string& op, const Workload<typename L::value_type>& w,
+                               std::size_t offset) {
+  if (op == "push") return L::Empty(w.values.size(), offset);
+  return L::Build(L::Prepare(w.values), offset);
+}
+
+// Runs op once on a heap from setup_op(); build has nothing left to do.
+template <typename L>
+void run_op(const std::string& op, const Workload<typename L::value_type>& w,
+            typename L::heap_type& h) {
+  if (op == "push") {
+    for (const auto& x : w.values) L::Push(h, x);
+  } else if (op == "pop") {
+    while (!h.empty()) L::Pop(h);
+  } else if (is_mix(op)) {
+    run_mix<L>(h, w.steps);
+  } else if (op != "build") {
+    throw std::invalid_argument("unknown operation: " + op);
+  }
+}
+
+// Runs op once on a traced heap and replays its accesses through a CacheSim
+// with the array at opt.sim_base. For ops on a built heap the build is
+// replayed first, uncounted, so they start with the caches it left behind.
+// Reads of the input and the mix script are not modelled.
+template <typename L>
+void simulate_op(const Workload<typename L::value_type>& w, const BenchOptions& opt,
+                 BenchResult& r) {
+  const std::size_t bytes = sizeof(typename L::value_type);
+  CacheSim sim(opt.sim);
+  auto h = setup_op<L>(r.op, w, r.offset);
+  auto& trace = h.instrument().trace;
+  if (r.op != "build") {
+    sim.Replay(trace, bytes, opt.sim_base);
+    sim.ResetCounters();
+    trace.clear();
+  }
+  run_op<L>(r.op, w, h);
+  sim.Replay(trace, bytes, opt.sim_base);
+  const double elements = static_cast<double>(r.size);
+  r.sim_accesses = trace.size() / elements;
+  for (const auto& c : sim.caches()) r.sim_misses.push_back(c.misses() / elements);
+  for (const auto& t : sim.tlbs()) r.sim_misses.push_back(t.misses() / elements);
+}
+
+// The same layout with its heap instrumented by policy I, for --work,
+// --latency and --depths; void for layouts that take no policy.
+template <typename L, typename I>
+struct InstrumentedLayout {
+  using type = void;
+};
+
+template <typename T, typename Index, typename Instrument, typename I>
+struct InstrumentedLayout<HeapLayout<T, Index, Instrument>, I> {
+  using type = HeapLayout<T, Index, I>;
+};
+
+template <typename L, typename I>
+using can_instrument =
+    std::integral_constant<bool, !std::is_void<typename InstrumentedLayout<L, I>::type>::value>;
+
+// Runs op once with an OpCounter and fills r.work. Setup work (the build for
+// pop and mixes, the reserve for push) is not counted, so push is a
+// repeated-Push build to set against build's bottom-up one.
+template <typename L>
+void count_work(const Workload<typename L::value_type>& w, BenchResult& r, std::true_type) {
+  using Counted = typename InstrumentedLayout<L, OpCounter>::type;
+  auto h = setup_op<Counted>(r.op, w, r.offset);
+  if (r.op != "build") h.instrument().Reset();
+  run_op<Counted>(r.op, w, h);
+  const auto c = h.instrument().total();
+  const double elements = static_cast<double>(r.size);
+  r.work = {c.compares / elements, c.moves / elements, c.levels / elements,
+            c.allocs / elements};
+}
+
+template <typename L>
+void count_work(const Workload<typename L::value_type>&, BenchResult&, std::false_type) {}
+
+// Runs op once with a SiftDepthSampler and fills r.depths. As for --work,
+// setup isn't recorded.
+template <typename L>
+void sample_depths(const Workload<typename L::value_type>& w, const BenchOptions& opt,
+                   BenchResult& r, std::true_type) {
+  using Sampled = typename InstrumentedLayout<L, SiftDepthSampler>::type;
+  auto h = setup_op<Sampled>(r.op, w, r.offset);
+  h.instrument().Reset();
+  h.instrument().set_period(opt.depth_period);
+  run_op<Sampled>(r.op, w, h);
+  for (int i = 0; i < kNumHeapOps; ++i) {
+    r.depths.push_back(h.instrument().depths(static_cast<HeapOp>(i)));
+  }
+}
+
+template <typename L>
+void sample_depths(const Workload<typename L::value_type>&, const BenchOptions&, BenchResult&,
+                   std::false_type) {}
+
+// Runs op with every Heap operation timed on each of r.threads threads and
+// fills r.latency from the merged histograms. Runs repeat, up to opt.trials,
+// until kMinLatencySamples operations are recorded. Setup isn't recorded.
+template <typename L>
+void time_ops(const Workload<typename L::value_type>& w, const BenchOptions& opt,
+              BenchResult& r, std::true_type) {
+  using Timed = typename InstrumentedLayout<L, LatencyRecorder>::type;
+  std::vector<OpLatencies> per_thread(r.threads);
+  auto work = [&](std::size_t t) {
+    for (std::size_t run = 0; run < opt.trials; ++run) {
+      auto h = setup_op<Timed>(r.op, w, r.offset);
+      if (r.op != "build") thread_latencies().Reset();
+      run_op<Timed>(r.op, w, h);
+      per_thread[t].Merge(thread_latencies());
+      thread_latencies().Reset();
+      std::uint64_t recorded = 0;
+      for (const auto& h : per_thread[t].ops) recorded += h.count();
+      if (recorded >= kMinLatencySamples) break;
+    }
+  };
+  if (r.threads == 1) {
+    work(0);
+  } else {
+    std::vector<std::thread> pool;
+    for (std::size_t t = 0; t < r.threads; ++t) pool.emplace_back(work, t);
+    for (auto& th : pool) th.join();
+  }
+  LatencyHistogram merged;
+  for (const auto& latencies : per_thread) {
+    for (const auto& h : latencies.ops) merged.Merge(h);
+  }
+  r.latency = {static_cast<double>(merged.Percentile(0.5)),
+               static_cast<double>(merged.Percentile(0.99)),
+               static_cast<double>(merged.Percentile(0.999)),
+               static_cast<double>(merged.max())};
+}
+
+template <typename L>
+void time_ops(const Workload<typename L::value_type>&, const BenchOptions&, BenchResult&,
+              std::false_type) {}
+
+template <typename L>
+void measure_op(const Workload<typename L::value_type>& w, const BenchOptions& opt,
+                BenchResult& r, std::true_type) {
+  if (opt.simulate) {
+    simulate_op<L>(w, opt, r);
+  } else {
+    sample_op<L>(w, opt, r);
+    r.summary = summarize(r.samples, opt.bootstrap);
+  }
+}
+
+template <typename L>
+void measure_op(const Workload<typename L::value_type>& w, const BenchOptions& opt,
+                BenchResult& r, std::false_type) {
+  sample_op<L>(w, opt, r);
+  r.summary = summarize(r.samples, opt.bootstrap);
+}
+
+// Benchmarks one op on one workload at every thread count and offset; the
+// relative column compares each offset with the first one.
+template <typename L>
+void bench_offsets(const std::string& type, const std::string& layout,
+                   const std::string& op, const std::string& input,
+                   const Workload<typename L::value_type>& w,
+                   const BenchOptions& opt, std::vector<BenchResult>& results) {
+  const std::vector<std::size_t> no_offset = {0};
+  for (const auto threads : opt.threads) {
+    const std::size_t first = results.size();
+    for (const auto offset : L::kHasOffset ? opt.offsets : no_offset) {
+      // A replay's size is its number of operations.
+      const std::size_t size = op == "replay" ? w.steps.size() : w.values.size();
+      BenchResult r{type, layout, op, input, 2, size, offset, threads, {}};
+      r.ops_per_run = op == "build" ? 1 : r.size;
+      r.element_bytes = sizeof(typename L::value_type);
+      const std::size_t elements = op == "replay" ? peak_size(w.steps, 0) : r.size;
+      r.bytes = (elements + (L::kHasOffset ? offset : 0)) * r.element_bytes;
+      r.fits = fitting_level(r.bytes, opt.caches);
+      measure_op<L>(w, opt, r, Traced<L>());
+      if (opt.work) {
+        count_work<L>(w, r, can_instrument<L, OpCounter>());
+      }
+      if (opt.latency) {
+        time_ops<L>(w, opt, r, can_instrument<L, LatencyRecorder>());
+      }
+      if (opt.depths) {
+        sample_depths<L>(w, opt, r, can_instrument<L, SiftDepthSampler>());
+      }
+      results.push_back(std::move(r));
+    }
+    if (opt.simulate) continue;
+    const Summary& base = results[first].summary;
+    for (std::size_t i = first; i < results.size(); ++i) {
+      const Summary& s = results[i].summary;
+      results[i].relative = s.median / base.median;
+      results[i].within_noise = s.ci_low <= base.ci_high && base.ci_low <= s.ci_high;
+    }
+  }
+}
+
+// Rough check that the input, a mix script, and one heap per thread fit in
+// half of physical memory.
+template <typename T>
+bool fits_in_memory(std::size_t size, const BenchOptions& opt) {
+  const long pages = sysconf(_SC_PHYS_PAGES);
+  const long page_size = sysconf(_SC_PAGESIZE);
+  if (pages <= 0 || page_size <= 0) return true;
+  const double physical = static_cast<double>(pages) * page_size;
+  const auto threads = *std::max_element(opt.threads.begin(), opt.threads.end());
+  const double needed = static_cast<double>(size) *
+                        (sizeof(T) * (1.0 + 2.0 * threads) + sizeof(MixStep));
+  return needed < physical / 2;
+}
+
+template <typename L>
+void bench_layout(const std::string& type, const std::string& layout,
+                  const BenchOptions& opt, std::vector<BenchResult>& results) {
+  using T = typename L::value_type;
+  for (const auto size : opt.sizes) {
+    if (!fits_in_memory<T>(size, opt)) {
+      std::cerr << "heap: skipping " << size << ' ' << type
+                << " elements, which would not fit in physical memory\n";
+      continue;
+    }
+    for (const auto& input : opt.inputs) {
+      Workload<T> w;
+      // A trace starts from an empty heap.
+      if (input != "trace") w.values = make_input<T>(input, size, opt.seed);
+      for (const auto& op : opt.ops) {
+        if (op == "replay") {
+          w.steps = opt.trace;
+        } else {
+          w.steps = is_mix(op) ? make_mix(op, size, opt.seed) : std::vector<MixStep>();
+        }
+        if (has_updates(w.steps) && !L::kHasUpdate) {
+          std::cerr << "heap: skipping " << op << " on " << layout
+                    << ", which has no decrease-key by position\n";
+          continue;
+        }
+        bench_offsets<L>(type, layout, op, input, w, opt, results);
+      }
+    }
+  }
+}
+
+template <typename T>
+struct TypeTag {
+  using type = T;
+};
+
+// AgingHeap only takes arithmetic priorities.
+template <typename T, typename Fn>
+void with_aging(const std::string&, Fn fn, std::true_type) {
+  fn(TypeTag<AgingLayout<T>>());
+}
+
+template <typename T, typename Fn>
+void with_aging(const std::string& type, Fn, std::false_type) {
+  std::cerr << "heap: skipping aging on " << type << ", which isn't arithmetic\n";
+}
+
+// Calls fn with a TypeTag for the named layout of type T (named type).
+template <typename T, typename Fn>
+void with_layout(const std::string& type, const std::string& layout, Fn fn) {
+  if (layout == "heap") {
+    fn(TypeTag<HeapLayout<T, std::size_t>>());
+  } else if (layout == "compact") {
+    fn(TypeTag<HeapLayout<T, std::uint32_t>>());
+  } else if (layout == "aligned") {
+    fn(TypeTag<AlignedLayout<T>>());
+  } else if (layout == "aging") {
+    with_aging<T>(type, fn, std::is_arithmetic<T>());
+  } else if (layout == "std-pq") {
+    fn(TypeTag<StdPriorityQueueLayout<T>>());
+  } else if (layout == "std-heap") {
+    fn(TypeTag<StdHeapLayout<T>>());
+  } else if (layout == "pairing") {
+    fn(TypeTag<PairingLayout<T>>());
+  } else {
+    throw std::invalid_argument("unknown layout: " + layout);
+  }
+}
+
+template <typename T>
+void bench_type(const std::string& type, const BenchOptions& opt,
+                std::vector<BenchResult>& results) {
+  for (const auto& layout : opt.layouts) {
+    if (opt.simulate) {
+      if (layout == "heap") {
+        bench_layout<HeapLayout<T, std::size_t, AccessRecorder>>(type, layout, opt, results);
+      } else if (layout == "compact") {
+        bench_layout<HeapLayout<T, std::uint32_t, AccessRecorder>>(type, layout, opt, results);
+      } else {
+        std::cerr << "heap: skipping " << layout << ", which records no access trace\n";
+      }
+      continue;
+    }
+    with_layout<T>(type, layout, [&](auto tag) {
+      bench_layout<typename decltype(tag)::type>(type, layout, opt, results);
+    });
+  }
+}
+
+bool same_scenario(const BenchResult& a, const BenchResult& b) {
+  return a.type == b.type && a.op == b.op && a.input == b.input &&
+         a.size == b.size && a.threads == b.threads;
+}
+
+// Fills in vs_baseline for every result whose scenario was also run on the
+// baseline layout (at its first offset).
+void compare_to_baseline(const std::string& baseline, std::vector<BenchResult>& results) {
+  for (auto& r : results) {
+    for (const auto& b : results) {
+      if (b.layout == baseline && same_scenario(r, b)) {
+        r.vs_baseline = b.summary.median / r.summary.median;
+        break;
+      }
+    }
+  }
+}
+
+// Writes a trace of the first op (and the build before it, as pushes) on the
+// first size and input, run through a RecordingHeap on a Heap of doubles.
+void record_trace(const BenchOptions& opt) {
+  std::ofstream out(opt.record_trace, std::ios::binary);
+  if (!out) throw std::runtime_error("can't write trace " + opt.record_trace);
+  const auto& op = opt.ops.front();
+  const auto size = opt.sizes.front();
+  Heap<double> heap(op == "push" ? std::vector<double>()
+                                 : make_input<double>(opt.inputs.front(), size, opt.seed));
+  auto recording = make_recording_heap(heap, out);
+  if (op == "push") {
+    for (const auto x : make_input<double>(opt.inputs.front(), size, opt.seed)) {
+      recording.Push(x);
+    }
+  } else if (op == "pop") {
+    while (!recording.empty()) recording.Pop();
+  } else if (is_mix(op) && op != "replay") {
+    double last = 0;
+    for (const auto& s : make_mix(op, size, opt.seed)) {
+      switch (s.op) {
+        case MixOp::kPush:
+          recording.Push(s.value);
+          break;
+        case MixOp::kPop:
+          last = recording.Pop();
+          break;
+        case MixOp::kPushAfterPop:
+          recording.Push(last + s.value);
+          break;
+        case MixOp::kDecrease:
+          recording.Update(s.pos, recording.At(s.pos) - s.value);
+          break;
+      }
+    }
+  } else if (op != "build") {
+    throw std::invalid_argument("can't record " + op);
+  }
+  if (!out.flush()) throw std::runtime_error("error writing trace " + opt.record_trace);
+}
+
+// Calls fn with a TypeTag for the named element type.
+template <typename Fn>
+void with_type(const std::string& type, Fn fn) {
+  if (type == "float") {
+    fn(TypeTag<float>());
+  } else if (type == "double") {
+    fn(TypeTag<double>());
+  } else if (type == "int32") {
+    fn(TypeTag<std::int32_t>());
+  } else if (type == "int64") {
+    fn(TypeTag<std::int64_t>());
+  } else if (type == "pair16") {
+    fn(TypeTag<Record<16>>());
+  } else if (type == "record32") {
+    fn(TypeTag<Record<32>>());
+  } else if (type == "record40") {
+    fn(TypeTag<Record<40>>());
+  } else if (type == "record64") {
+    fn(TypeTag<Record<64>>());
+  } else {
+    throw std::invalid_argument("unknown element type: " + type);
+  }
+}
+
+void run_benchmarks(const BenchOptions& opt, std::vector<BenchResult>& results) {
+  for (const auto& type : opt.types) {
+    with_type(type, [&](auto tag) {
+      bench_type<typename decltype(tag)::type>(type, opt, results);
+    });
+  }
+  if (!opt.simulate) compare_to_baseline(opt.baseline, results);
+}
+
+//
+// Scaling benchmark: one concurrent front end shared by all threads
+//
+
+struct Cpu {
+  int id;
+  int package;  // socket
+  int core;
+};
+
+// The CPUs this process may run on, with their socket and core from sysfs.
+std::vector<Cpu> allowed_cpus() {
+  std::vector<Cpu> cpus;
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  if (sched_getaffinity(0, sizeof(set), &set) != 0) return cpus;
+  for (int id = 0; id < CPU_SETSIZE; ++id) {
+    if (!CPU_ISSET(id, &set)) continue;
+    const std::string dir = "/sys/devices/system/cpu/cpu" + std::to_string(id) + "/topology/";
+    Cpu cpu{id, 0, id};
+    std::ifstream(dir + "physical_package_id") >> cpu.package;
+    std::ifstream(dir + "core_id") >> cpu.core;
+    cpus.push_back(cpu);
+  }
+#endif
+  return cpus;
+}
+
+// Orders CPUs for thread placement: "compact" fills a socket, core by core,
+// before the next; "spread" alternates sockets. "none" returns no CPUs,
+// leaving threads unpinned.
+std::vector<Cpu> place_cpus(const std::string& placement, std::vector<Cpu> cpus) {
+  if (placement == "none") return {};
+  std::sort(cpus.begin(), cpus.end(), [](const Cpu& a, const Cpu& b) {
+    return std::tie(a.package, a.core, a.id) < std::tie(b.package, b.core, b.id);
+  });
+  if (placement == "compact") return cpus;
+  if (placement != "spread") throw std::invalid_argument("unknown placement: " + placement);
+  std::vector<std::vector<Cpu>> sockets;
+  for (const auto& cpu : cpus) {
+    if (sockets.empty() || sockets.back().front().package != cpu.package) sockets.emplace_back();
+    sockets.back().push_back(cpu);
+  }
+  std::vector<Cpu> spread;
+  for (std::size_t i = 0; spread.size() < cpus.size(); ++i) {
+    for (const auto& socket : sockets) {
+      if (i < socket.size()) spread.push_back(socket[i]);
+    }
+  }
+  return spread;
+}
+
+// Pins the calling thread to one CPU; returns false if that isn't possible.
+bool pin_thread(int cpu) {
+#ifdef __linux__
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#else
+  (void)cpu;
+  return false;
+#endif
+}
+
+struct ScalingResult {
+  std::string type;
+  std::string frontend;
+  std::string op;
+  std::string input;
+  std::size_t size;       // elements in the front end at the start
+  std::size_t threads;
+  std::string placement;
+  std::size_t sockets;    // sockets the threads were pinned to; 0 if unpinned
+  std::vector<double> per_thread;  // successful operations per second
+  double total = 0;       // sum of per_thread
+  double fairness = 0;    // Jain's index of per_thread, 1/threads to 1
+  double speedup = 0;     // total over the 1-thread total; 0 if not run
+};
+
+// Jain's fairness index: (sum x)^2 / (n sum x^2).
+double jain_fairness(const std::vector<double>& x) {
+  double sum = 0, squares = 0;
+  for (const auto v : x) {
+    sum += v;
+    squares += v * v;
+  }
+  return squares > 0 ? sum * sum / (x.size() * squares) : 0;
+}
+
+// The script thread t of threads cycles through. producer-consumer makes
+// even threads push and odd ones pop (a single thread alternates); other
+// ops are the mixes, seeded per thread.
+std::vector<MixStep> make_thread_script(const std::string& op, std::size_t n,
+                                        std::uint64_t seed, std::size_t t,
+                                        std::size_t threads) {
+  if (op != "producer-consumer") return make_mix(op, n, seed + t);
+  std::mt19937_64 rng(seed + t);
+  std::uniform_real_distribution<double> key(0, static_cast<double>(n));
+  std::vector<MixStep> steps;
+  for (std::size_t i = 0; i < n; ++i) {
+    const bool push = threads == 1 ? i % 2 == 0 : t % 2 == 0;
+    steps.push_back(push ? MixStep{MixOp::kPush, 0, std::floor(key(rng))}
+                         : MixStep{MixOp::kPop, 0, 0});
+  }
+  return steps;
+}
+
+// Fills a Front with the input, then runs threads threads, each cycling
+// through its own script against it for opt.duration seconds, and records
+// each thread's rate of successful operations. A pop that finds the front
+// end empty doesn't count.
+template <typename T, typename Front>
+void scale_front(ScalingResult& r, const std::vector<Cpu>& cpus, const BenchOptions& opt) {
+  Front front(r.threads);
+  for (const auto& x : make_input<T>(r.input, r.size, opt.seed)) front.Push(x);
+  std::vector<std::vector<MixStep>> scripts;
+  for (std::size_t t = 0; t < r.threads; ++t) {
+    scripts.push_back(make_thread_script(r.op, std::max<std::size_t>(r.size, 1), opt.seed, t,
+                                         r.threads));
+  }
+  if (std::any_of(scripts.begin(), scripts.end(),
+                  [](const std::vector<MixStep>& s) { return has_updates(s); })) {
+    throw std::invalid_argument(r.op + " needs decrease-key, which front ends don't have");
+  }
+  std::atomic<std::size_t> ready{0};
+  std::atomic<bool> go{false}, stop{false};
+  r.per_thread.assign(r.threads, 0);
+  auto work = [&](std::size_t t) {
+    if (!cpus.empty()) pin_thread(cpus[t % cpus.size()].id);
+    ++ready;
+    while (!go.load()) std::this_thread::yield();
+    const auto start = std::chrono::steady_clock::now();
+    const auto& script = scripts[t];
+    std::uint64_t done = 0;
+    std::size_t i = 0;
+    T last = T();
+    while (!stop.load(std::memory_order_relaxed)) {
+      for (int k = 0; k < 64; ++k) {
+        const auto& s = script[i];
+        if (++i == script.size()) i = 0;
+        switch (s.op) {
+          case MixOp::kPush:
+            front.Push(static_cast<T>(s.value));
+            ++done;
+            break;
+          case MixOp::kPop:
+            if (front.TryPop(last)) ++done;
+            break;
+          case MixOp::kPushAfterPop:
+            front.Push(static_cast<T>(last + s.value));
+            ++done;
+            break;
+          case MixOp::kDecrease:
+            break;
+        }
+      }
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    escape(last);
+    r.per_thread[t] = done / elapsed.count();
+  };
+  std::vector<std::thread> pool;
+  for (std::size_t t = 0; t < r.threads; ++t) pool.emplace_back(work, t);
+  while (ready.load() < r.threads) std::this_thread::yield();
+  go = true;
+  std::this_thread::sleep_for(std::chrono::duration<double>(opt.duration));
+  stop = true;
+  for (auto& th : pool) th.join();
+  r.total = std::accumulate(r.per_thread.begin(), r.per_thread.end(), 0.0);
+  r.fairness = jain_fairness(r.per_thread);
+}
+
+template <typename T>
+void scale_type(const std::string& type, const BenchOptions& opt,
+                std::vector<ScalingResult>& results) {
+  const auto all = allowed_cpus();
+  for (const auto& placement : opt.placements) {
+    const auto cpus = place_cpus(placement, all);
+    for (const auto& op : opt.ops) {
+      for (const auto& input : opt.inputs) {
+        for (const auto size : opt.sizes) {
+          for (const auto& frontend : opt.frontends) {
+            for (const auto threads : opt.threads) {
+              ScalingResult r{type, frontend, op, input, size, threads, placement, 0, {}};
+              std::vector<int> sockets;
+              for (std::size_t t = 0; t < std::min(threads, cpus.size()); ++t) {
+                sockets.push_back(cpus[t].package);
+              }
+              std::sort(sockets.begin(), sockets.end());
+              r.sockets = std::unique(sockets.begin(), sockets.end()) - sockets.begin();
+              if (frontend == "locked") {
+                scale_front<T, LockedHeap<T>>(r, cpus, opt);
+              } else if (frontend == "sharded") {
+                scale_front<T, ShardedHeap<T>>(r, cpus, opt);
+              } else if (frontend == "multiqueue") {
+                scale_front<T, MultiQueue<T>>(r, cpus, opt);
+              } else {
+                throw std::invalid_argument("unknown front end: " + frontend);
+              }
+              results.push_back(std::move(r));
+            }
+          }
+        }
+      }
+    }
+  }
+}
+
+//
+// Hold model: a steady-size heap where each step pops the minimum and pushes
+// it back later by a random increment
+//
+
+// Draws hold-model increments with mean scale. The shapes follow the classic
+// priority queue studies: exponential, uniform on [0, 2), bimodal (90% small,
+// 10% large) and triangular (rising to a peak at 1.5).
+class IncrementGenerator {
+ public:
+  IncrementGenerator(const std::string& dist, double scale, std::uint64_t seed)
+      : dist_(dist), scale_(scale), rng_(seed) {
+    if (dist != "exponential" && dist != "uniform" && dist != "bimodal" &&
+        dist != "triangular") {
+      throw std::invalid_argument("unknown increment distribution: " + dist);
+    }
+  }
+
+  double operator()() {
+    const double u = u_(rng_);
+    double x;
+    if (dist_ == "exponential") {
+      x = -std::log(1 - u);
+    } else if (dist_ == "uniform") {
+      x = 2 * u;
+    } else if (dist_ == "bimodal") {
+      x = u_(rng_) < 0.9 ? 0.2 * u : 18.2 * u;
+    } else {
+      x = 1.5 * std::max(u, u_(rng_));
+    }
+    return std::floor(x * scale_);
+  }
+
+ private:
+  std::string dist_;
+  double scale_;
+  std::mt19937_64 rng_;
+  std::uniform_real_distribution<double> u_{0, 1};
+};
+
+struct HoldResult {
+  std::string type;
+  std::string layout;
+  std::string increments;
+  std::size_t size;
+  std::size_t offset;
+  std::uint64_t ops;        // measured hold steps
+  double mean_ns = 0;
+  std::vector<double> latency;  // ns per hold step: p50, p99, p99.9, max
+};
+
+// Warmup hold steps per element before measuring, to reach steady state.
+constexpr std::size_t kHoldWarmupFactor = 4;
+
+// Builds a heap of r.size keys drawn from the increments, runs
+// kHoldWarmupFactor * size hold steps, then times each of r.ops more.
+// Increments have mean size, so integer keys stay distinct enough; each
+// step's time includes two steady_clock reads.
+template <typename L>
+void hold_model(HoldResult& r, const BenchOptions& opt) {
+  using T = typename L::value_type;
+  IncrementGenerator increment(r.increments, static_cast<double>(r.size), opt.seed);
+  std::vector<T> initial;
+  initial.reserve(r.size);
+  for (std::size_t i = 0; i < r.size; ++i) initial.push_back(static_cast<T>(increment()));
+  auto h = L::Build(L::Prepare(initial), r.offset);
+  for (std::size_t i = 0; i < kHoldWarmupFactor * r.size; ++i) {
+    const T x = L::Pop(h);
+    L::Push(h, static_cast<T>(x + increment()));
+  }
+  LatencyHistogram latency;
+  double total_ns = 0;
+  for (std::uint64_t i = 0; i < r.ops; ++i) {
+    const double inc = increment();
+    const auto start = std::chrono::steady_clock::now();
+    const T x = L::Pop(h);
+    L::Push(h, static_cast<T>(x + inc));
+    const auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                        std::chrono::steady_clock::now() - start).count();
+    latency.Record(static_cast<std::uint64_t>(ns));
+    total_ns += ns;
+  }
+  escape(h);
+  r.mean_ns = total_ns / r.ops;
+  r.latency = {static_cast<double>(latency.Percentile(0.5)),
+               static_cast<double>(latency.Percentile(0.99)),
+               static_cast<double>(latency.Percentile(0.999)),
+               static_cast<double>(latency.max())};
+}
+
+template <typename T>
+void hold_type(const std::string& type, const BenchOptions& opt,
+               std::vector<HoldResult>& results) {
+  const std::vector<std::size_t> no_offset = {0};
+  for (const auto& layout : opt.layouts) {
+    with_layout<T>(type, layout, [&](auto tag) {
+      using L = typename decltype(tag)::type;
+      for (const auto size : opt.sizes) {
+        if (size == 0) continue;
+        for (const auto& increments : opt.increments) {
+          for (const auto offset : L::kHasOffset ? opt.offsets : no_offset) {
+            HoldResult r{type, layout, increments, size, offset,
+                         std::max<std::uint64_t>(size, kMinLatencySamples)};
+            hold_model<L>(r, opt);
+            results.push_back(std::move(r));
+          }
+        }
+      }
+    });
+  }
+}
+
+// Results come out grouped by type, size and increments, layouts in order.
+void run_hold(const BenchOptions& opt, std::vector<HoldResult>& results) {
+  for (const auto& type : opt.types) {
+    with_type(type, [&](auto tag) {
+      hold_type<typename decltype(tag)::type>(type, opt, results);
+    });
+  }
+  auto position = [](const std::vector<std::string>& names, const std::string& name) {
+    return std::find(names.begin(), names.end(), name) - names.begin();
+  };
+  std::stable_sort(results.begin(), results.end(), [&](const HoldResult& a, const HoldResult& b) {
+    return std::make_tuple(position(opt.types, a.type), a.size,
+                           position(opt.increments, a.increments)) <
+           std::make_tuple(position(opt.types, b.type), b.size,
+                           position(opt.increments, b.increments));
+  });
+}
+
+// How often --publish-metrics publishes.
+constexpr std::chrono::milliseconds kMetricsInterval(10);
+
+// Runs hold steps on a Heap<double> of the first size for opt.duration
+// seconds, publishing its metrics to opt.publish_metrics every
+// kMetricsInterval, as a live heap for an agent to watch. Returns the final
+// snapshot.
+MetricsSnapshot publish_metrics(const BenchOptions& opt) {
+  const std::size_t size = opt.sizes.front();
+  if (size == 0) throw std::invalid_argument("--publish-metrics needs a nonzero size");
+  MetricsPage page(opt.publish_metrics);
+  IncrementGenerator increment(opt.increments.front(), static_cast<double>(size), opt.seed);
+  std::vector<double> initial;
+  initial.reserve(size);
+  for (std::size_t i = 0; i < size; ++i) initial.push_back(increment());
+  Heap<double, std::size_t, MetricsRecorder> heap(initial);
+  const auto start = std::chrono::steady_clock::now();
+  const auto end = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                               std::chrono::duration<double>(opt.duration));
+  auto next = start;
+  for (auto now = start; now < end; now = std::chrono::steady_clock::now()) {
+    if (now >= next) {
+      heap.instrument().Publish(page, heap.size());
+      next = now + kMetricsInterval;
+    }
+    for (int i = 0; i < 256; ++i) heap.Push(heap.Pop() + increment());
+  }
+  heap.instrument().Publish(page, heap.size());
+  return heap.instrument().snapshot();
+}
+
+//
+// Graph search: Dijkstra, A* and Prim on generated graphs, with every layout
+// as the priority queue
+//
+
+// Undirected graph in compressed sparse rows; each edge appears once from
+// each end. Grid graphs keep their side, for A*'s heuristic.
+struct Graph {
+  std::vector<std::uint32_t> first;  // v's edges are [first[v], first[v + 1])
+  std::vector<std::uint32_t> target;
+  std::vector<std::uint32_t> weight;
+  std::size_t side = 0;              // 0 unless a grid
+
+  std::size_t vertices() const { return first.size() - 1; }
+  std::size_t edges() const { return target.size() / 2; }
+};
+
+constexpr std::uint32_t kMaxEdgeWeight = 100;
+
+struct WeightedEdge {
+  std::uint32_t a;
+  std::uint32_t b;
+  std::uint32_t weight;
+};
+
+Graph make_csr(std::size_t n, const std::vector<WeightedEdge>& edges) {
+  Graph g;
+  g.first.assign(n + 1, 0);
+  for (const auto& e : edges) {
+    ++g.first[e.a + 1];
+    ++g.first[e.b + 1];
+  }
+  std::partial_sum(g.first.begin(), g.first.end(), g.first.begin());
+  g.target.resize(2 * edges.size());
+  g.weight.resize(2 * edges.size());
+  auto next = g.first;
+  for (const auto& e : edges) {
+    g.target[next[e.a]] = e.b;
+    g.weight[next[e.a]++] = e.weight;
+    g.target[next[e.b]] = e.a;
+    g.weight[next[e.b]++] = e.weight;
+  }
+  return g;
+}
+
+// kind "grid" is road-like: a square grid of about n intersections, streets
+// to the four neighbours of random length 1 to kMaxEdgeWeight. kind
+// "random" has n vertices, each joined to a random earlier one (so the graph
+// is connected) plus 3n random edges: average degree 8, small diameter.
+Graph make_graph(const std::string& kind, std::size_t n, std::uint64_t seed) {
+  if (n < 2 || n > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::invalid_argument("graph sizes must be from 2 to 2^32 - 1 vertices");
+  }
+  std::mt19937_64 rng(seed);
+  std::uniform_int_distribution<std::uint32_t> weight(1, kMaxEdgeWeight);
+  std::vector<WeightedEdge> edges;
+  if (kind == "grid") {
+    const auto side = std::max<std::size_t>(
+        static_cast<std::size_t>(std::sqrt(static_cast<double>(n))), 2);
+    edges.reserve(2 * side * side);
+    for (std::size_t y = 0; y < side; ++y) {
+      for (std::size_t x = 0; x < side; ++x) {
+        const auto v = static_cast<std::uint32_t>(y * side + x);
+        if (x + 1 < side) edges.push_back({v, v + 1, weight(rng)});
+        if (y + 1 < side) edges.push_back({v, static_cast<std::uint32_t>(v + side), weight(rng)});
+      }
+    }
+    Graph g = make_csr(side * side, edges);
+    g.side = side;
+    return g;
+  }
+  if (kind == "random") {
+    edges.reserve(4 * n);
+    for (std::size_t v = 1; v < n; ++v) {
+      edges.push_back({static_cast<std::uint32_t>(v),
+                       std::uniform_int_distribution<std::uint32_t>(
+                           0, static_cast<std::uint32_t>(v - 1))(rng),
+                       weight(rng)});
+    }
+    std::uniform_int_distribution<std::uint32_t> vertex(0, static_cast<std::uint32_t>(n - 1));
+    for (std::size_t i = 0; i < 3 * n; ++i) edges.push_back({vertex(rng), vertex(rng), weight(rng)});
+    return make_csr(n, edges);
+  }
+  throw std::invalid_argument("unknown graph: " + kind);
+}
+
+// Queue entries pack a priority and a vertex into one std::uint64_t,
+// priority in the high half, so every layout (aging included) orders them by
+// priority with no payload type.
+std::uint64_t pack_entry(std::uint64_t priority, std::uint32_t v) {
+  if (priority > std::numeric_limits<std::uint32_t>::max()) {
+    throw std::overflow_error("graph distance exceeds 32 bits");
+  }
+  return priority << 32 | v;
+}
+
+struct SearchCounts {
+  std::uint64_t pushes = 0;
+  std::uint64_t pops = 0;
+  std::uint64_t decreases = 0;
+  std::uint64_t checksum = 0;  // compared across layouts
+
+  std::uint64_t ops() const { return pushes + pops + decreases; }
+  bool operator!=(const SearchCounts& other) const {
+    return pushes != other.pushes || pops != other.pops || decreases != other.decreases;
+  }
+};
+
+// Layouts whose Push returns a handle for Decrease(), so a search can lower
+// a queued vertex's priority in place.
+template <typename L>
+struct Handled : std::false_type {};
+
+template <typename T>
+struct Handled<PairingLayout<T>> : std::true_type {};
+
+// How a search queues a vertex whose priority improved to entry. Without
+// handles it is decrease-key by lazy deletion: the vertex is pushed again
+// and the stale entry skipped when popped.
+template <typename L, bool = Handled<L>::value>
+class SearchQueue {
+ public:
+  explicit SearchQueue(std::size_t) {}
+  void Improve(typename L::heap_type& heap, std::uint32_t, std::uint64_t entry,
+               SearchCounts& c) {
+    L::Push(heap, entry);
+    ++c.pushes;
+  }
+  void Popped(std::uint32_t) {}
+};
+
+// With handles, a queued vertex's entry is lowered in place.
+template <typename L>
+class SearchQueue<L, true> {
+ public:
+  explicit SearchQueue(std::size_t n) : queued_(n, nullptr) {}
+  void Improve(typename L::heap_type& heap, std::uint32_t v, std::uint64_t entry,
+               SearchCounts& c) {
+    if (queued_[v]) {
+      L::Decrease(heap, queued_[v], entry);
+      ++c.decreases;
+    } else {
+      queued_[v] = L::Push(heap, entry);
+      ++c.pushes;
+    }
+  }
+  void Popped(std::uint32_t v) { queued_[v] = nullptr; }
+
+ private:
+  std::vector<typename L::handle_type> queued_;
+};
+
+// Dijkstra from vertex 0, or with astar A* from one corner of a grid to the
+// opposite one under the Manhattan distance times the lightest street.
+// Improved vertices go through a SearchQueue. dist is scratch space.
+template <typename L>
+SearchCounts shortest_paths(const Graph& g, std::size_t offset, bool astar,
+                            std::vector<std::uint32_t>& dist) {
+  constexpr auto kUnreached = std::numeric_limits<std::uint32_t>::max();
+  const auto n = g.vertices();
+  const std::uint32_t goal = static_cast<std::uint32_t>(n - 1);
+  auto h = [&](std::uint32_t v) -> std::uint64_t {
+    if (!astar) return 0;
+    const auto x = v % g.side, y = v / g.side;
+    return (g.side - 1 - x) + (g.side - 1 - y);  // lightest street weighs 1
+  };
+  dist.assign(n, kUnreached);
+  auto heap = L::Empty(n, offset);
+  SearchQueue<L> queue(n);
+  SearchCounts c;
+  dist[0] = 0;
+  queue.Improve(heap, 0, pack_entry(h(0), 0), c);
+  while (c.pops < c.pushes) {
+    const std::uint64_t top = L::Pop(heap);
+    ++c.pops;
+    const auto u = static_cast<std::uint32_t>(top);
+    queue.Popped(u);
+    if ((top >> 32) != dist[u] + h(u)) continue;  // stale
+    if (astar && u == goal) break;
+    for (auto e = g.first[u]; e < g.first[u + 1]; ++e) {
+      const auto v = g.target[e];
+      const std::uint64_t d = std::uint64_t{dist[u]} + g.weight[e];
+      if (d < dist[v]) {
+        dist[v] = static_cast<std::uint32_t>(d);
+        queue.Improve(heap, v, pack_entry(d + h(v), v), c);
+      }
+    }
+  }
+  if (astar) {
+    c.checksum = dist[goal];
+  } else {
+    for (const auto d : dist) c.checksum += d == kUnreached ? 0 : d;
+  }
+  escape(heap);
+  return c;
+}
+
+// Prim's minimum spanning tree from vertex 0: a vertex's entry improves
+// whenever a lighter edge to it turns up. best is scratch space.
+template <typename L>
+SearchCounts spanning_tree(const Graph& g, std::size_t offset, std::vector<std::uint32_t>& best) {
+  constexpr auto kInTree = std::uint32_t{0};  // edge weights are at least 1
+  const auto n = g.vertices();
+  best.assign(n, std::numeric_limits<std::uint32_t>::max());
+  auto heap = L::Empty(n, offset);
+  SearchQueue<L> queue(n);
+  SearchCounts c;
+  queue.Improve(heap, 0, pack_entry(0, 0), c);
+  while (c.pops < c.pushes) {
+    const std::uint64_t top = L::Pop(heap);
+    ++c.pops;
+    const auto u = static_cast<std::uint32_t>(top);
+    queue.Popped(u);
+    if (best[u] == kInTree) continue;  // stale
+    c.checksum += top >> 32;
+    best[u] = kInTree;
+    for (auto e = g.first[u]; e < g.first[u + 1]; ++e) {
+      const auto v = g.target[e];
+      if (g.weight[e] < best[v]) {
+        best[v] = g.weight[e];
+        queue.Improve(heap, v, pack_entry(g.weight[e], v), c);
+      }
+    }
+  }
+  escape(heap);
+  return c;
+}
+
+template <typename L>
+SearchCounts run_search(const std::string& algorithm, const Graph& g, std::size_t offset,
+                        std::vector<std::uint32_t>& scratch) {
+  if (algorithm == "prim") return spanning_tree<L>(g, offset, scratch);
+  return shortest_paths<L>(g, offset, algorithm == "astar", scratch);
+}
+
+struct GraphResult {
+  std::string graph;
+  std::string algorithm;
+  std::size_t vertices;
+  std::size_t edges;
+  std::string layout;
+  std::size_t offset;
+  SearchCounts counts;
+  std::vector<double> samples;  // seconds per search
+  Summary summary;
+};
+
+// Times opt.trials searches with layout L at every offset, after one
+// untimed search whose checksum must match reference.
+template <typename L>
+void graph_layout(const Graph& g, const std::string& graph, const std::string& algorithm,
+                  const std::string& layout, std::uint64_t reference, const BenchOptions& opt,
+                  std::vector<GraphResult>& results) {
+  const std::vector<std::size_t> no_offset = {0};
+  std::vector<std::uint32_t> scratch;
+  for (const auto offset : L::kHasOffset ? opt.offsets : no_offset) {
+    GraphResult r{graph, algorithm, g.vertices(), g.edges(), layout, offset};
+    r.counts = run_search<L>(algorithm, g, offset, scratch);
+    if (r.counts.checksum != reference) {
+      throw std::logic_error(layout + " got a different " + algorithm + " result on " + graph);
+    }
+    for (std::size_t t = 0; t < opt.trials; ++t) {
+      const auto start = std::chrono::steady_clock::now();
+      escape(run_search<L>(algorithm, g, offset, scratch));
+      r.samples.push_back(
+          std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    r.summary = summarize(r.samples, opt.bootstrap);
+    results.push_back(std::move(r));
+  }
+}
+
+void run_graphs(const BenchOptions& opt, std::vector<GraphResult>& results) {
+  for (const auto& graph : opt.graphs) {
+    for (const auto size : opt.sizes) {
+      const Graph g = make_graph(graph, size, opt.seed);
+      for (const auto& algorithm : opt.algorithms) {
+        if (algorithm == "astar" && g.side == 0) {
+          std::cerr << "heap: skipping astar on " << graph << ", which has no coordinates\n";
+          continue;
+        }
+        std::vector<std::uint32_t> scratch;
+        const auto reference =
+            run_search<HeapLayout<std::uint64_t, std::size_t>>(algorithm, g, 0, scratch).checksum;
+        for (const auto& layout : opt.layouts) {
+          with_layout<std::uint64_t>("graph entries", layout, [&](auto tag) {
+            graph_layout<typename decltype(tag)::type>(g, graph, algorithm, layout, reference,
+                                                       opt, results);
+          });
+        }
+      }
+    }
+  }
+}
+
+struct StatsResult {
+  std::string type;
+  std::string layout;
+  HeapStats stats;
+};
+
+// Builds each layout of type T from the first input at every size and
+// offset, and records its Stats() against the first cache's line size.
+template <typename T>
+void stats_type(const std::string& type, const BenchOptions& opt,
+                std::vector<StatsResult>& results) {
+  const std::size_t line =
+      opt.caches.empty() || !opt.caches.front().line ? kCacheLineSize : opt.caches.front().line;
+  const std::vector<std::size_t> no_offset = {0};
+  for (const auto size : opt.sizes) {
+    const auto values = make_input<T>(opt.inputs.front(), size, opt.seed);
+    for (const auto& layout : opt.layouts) {
+      with_layout<T>(type, layout, [&](auto tag) {
+        using L = typename decltype(tag)::type;
+        const auto in = L::Prepare(values);
+        for (const auto offset : L::kHasOffset ? opt.offsets : no_offset) {
+          results.push_back({type, layout, L::Stats(L::Build(in, offset), line)});
+        }
+      });
+    }
+  }
+}
+
+void run_stats(const BenchOptions& opt, std::vector<StatsResult>& results) {
+  for (const auto& type : opt.types) {
+    with_type(type, [&](auto tag) {
+      stats_type<typename decltype(tag)::type>(type, opt, results);
+    });
+  }
+}
+
+struct ModelResult {
+  std::string type;
+  std::size_t size;
+  LayoutModel model;
+  LayoutPrediction prediction;
+};
+
+// The layout model at every type, arity, size and offset, for an array at
+// --sim-base with the simulator's line and page sizes.
+void run_model(const BenchOptions& opt, std::vector<ModelResult>& results) {
+  for (const auto& type : opt.types) {
+    std::size_t element_bytes = 0;
+    with_type(type, [&](auto tag) { element_bytes = sizeof(typename decltype(tag)::type); });
+    for (const auto arity : opt.arities) {
+      for (const auto size : opt.sizes) {
+        for (const auto offset : opt.offsets) {
+          const LayoutModel m{element_bytes, arity, offset, opt.sim_base, opt.sim.line,
+                              opt.sim.page};
+          results.push_back({type, size, m, predict_layout(m, size)});
+        }
+      }
+    }
+  }
+}
+
+void run_scaling(const BenchOptions& opt, std::vector<ScalingResult>& results) {
+  for (const auto& type : opt.types) {
+    with_type(type, [&](auto tag) {
+      scale_type<typename decltype(tag)::type>(type, opt, results);
+    });
+  }
+  for (auto& r : results) {
+    for (const auto& one : results) {
+      if (one.threads == 1 && one.type == r.type && one.frontend == r.frontend &&
+          one.op == r.op && one.input == r.input && one.size == r.size &&
+          one.placement == r.placement) {
+        r.speedup = r.total / one.total;
+      }
+    }
+  }
+}
+
+// Sketch of r.depths for the text reports: per sifting operation, the mean
+// and p99 levels moved and the share of sifts within one level.
+void report_depths(const BenchResult& r, std::ostream& os) {
+  if (r.depths.empty()) return;
+  os << "\t\tsift depth:";
+  const char* sep = " ";
+  for (int i = 0; i < kNumHeapOps; ++i) {
+    const auto& h = r.depths[i];
+    if (h.count() == 0) continue;
+    os << sep << op_name(static_cast<HeapOp>(i)) << " mean " << h.mean() << ", p99 "
+       << h.Percentile(0.99) << ", " << h.share_within(1) * 100 << "% within 1 level";
+    sep = "; ";
+  }
+  os << '\n';
+}
+
+void report_text(const std::vector<BenchResult>& results, const BenchOptions& opt,
+                 std::ostream& os) {
+  os << "Caches: " << describe_caches(opt.caches) << '\n';
+  const BenchResult* group = nullptr;
+  for (const auto& r : results) {
+    if (!group || group->type != r.type || group->layout != r.layout ||
+        group->op != r.op || group->input != r.input || group->size != r.size ||
+        group->threads != r.threads) {
+      group = &r;
+      os << r.type << " elements, " << r.layout << " layout: " << r.op << " on "
+         << r.size << ' ' << r.input << " keys (" << format_bytes(r.bytes) << ", fits "
+         << r.fits << "), " << r.threads << " thread(s), " << r.samples.size()
+         << " samples of " << r.batch << " run(s)\n";
+    }
+    const Summary& s = r.summary;
+    os << "\tHeap offset used: " << r.offset << " median " << s.median
+       << " s (95% CI " << s.ci_low << " - " << s.ci_high << "), p90 " << s.p90
+       << ", p99 " << s.p99 << ", stddev " << s.stddev << ", "
+       << s.median * 1e9 / r.size << " ns/element, "
+       << s.median * 1e9 / r.ops_per_run << " ns/op, " << r.relative << "x of offset "
+       << group->offset;
+    if (s.outliers) os << ", " << s.outliers << " outlier(s) dropped";
+    if (&r != group && r.within_noise) os << " [within noise]";
+    os << '\n';
+    if (!r.counters.empty()) {
+      os << "\t\tper element:";
+      for (int e = 0; e < PerfCounters::kNumEvents; ++e) {
+        os << ' ' << PerfCounters::name(static_cast<PerfCounters::Event>(e)) << ' ';
+        if (r.counters[e] >= 0) {
+          os << r.counters[e];
+        } else {
+          os << "n/a";
+        }
+      }
+      os << '\n';
+    }
+    if (!r.work.empty()) {
+      os << "\t\twork per element: compares " << r.work[0] << ", moves " << r.work[1]
+         << ", levels " << r.work[2] << ", allocations " << r.work[3] << '\n';
+    }
+    if (!r.latency.empty()) {
+      os << "\t\tlatency per operation: p50 " << r.latency[0] << " ns, p99 "
+         << r.latency[1] << " ns, p99.9 " << r.latency[2] << " ns, max "
+         << r.latency[3] << " ns\n";
+    }
+    report_depths(r, os);
+  }
+}
+
+// Names of the simulated levels, in BenchResult::sim_misses order.
+std::vector<std::string> sim_level_names(const CacheSimConfig& sim) {
+  std::vector<std::string> names;
+  for (std::size_t i = 0; i < sim.caches.size(); ++i) names.push_back("L" + std::to_string(i + 1));
+  for (std::size_t i = 0; i < sim.tlbs.size(); ++i) names.push_back("TLB" + std::to_string(i + 1));
+  return names;
+}
+
+std::string describe_sim(const BenchOptions& opt) {
+  std::ostringstream os;
+  os << "array at byte " << opt.sim_base << ", " << opt.sim.line << " B lines, "
+     << opt.sim.page << " B pages;";
+  const auto names = sim_level_names(opt.sim);
+  for (std::size_t i = 0; i < opt.sim.caches.size(); ++i) {
+    os << ' ' << names[i] << ' ' << format_bytes(opt.sim.caches[i].size) << '/'
+       << opt.sim.caches[i].ways << "-way";
+  }
+  for (std::size_t i = 0; i < opt.sim.tlbs.size(); ++i) {
+    os << ' ' << names[opt.sim.caches.size() + i] << ' ' << opt.sim.tlbs[i].size << '/'
+       << opt.sim.tlbs[i].ways << "-way";
+  }
+  return os.str();
+}
+
+// --simulate results: element accesses and simulated misses per element.
+void report_simulation(const std::vector<BenchResult>& results, const BenchOptions& opt,
+                       std::ostream& os) {
+  os << "Simulated: " << describe_sim(opt) << '\n';
+  const auto names = sim_level_names(opt.sim);
+  const BenchResult* group = nullptr;
+  for (const auto& r : results) {
+    if (!group || group->type != r.type || group->layout != r.layout ||
+        group->op != r.op || group->input != r.input || group->size != r.size) {
+      group = &r;
+      os << r.type << " elements, " << r.layout << " layout: " << r.op << " on "
+         << r.size << ' ' << r.input << " keys (" << format_bytes(r.bytes) << ")\n";
+    }
+    os << "\tHeap offset used: " << r.offset << ' ' << r.sim_accesses
+       << " accesses/element, misses/element:";
+    for (std::size_t i = 0; i < names.size(); ++i) os << ' ' << names[i] << ' ' << r.sim_misses[i];
+    os << '\n';
+    if (r.op != "replay") {
+      const auto p = predict_layout({r.element_bytes, r.arity, r.offset, opt.sim_base,
+                                     opt.sim.line, opt.sim.page},
+                                    r.size);
+      os << "\t\tmodel: " << p.path_lines << " lines, " << p.path_pages
+         << " pages per root-to-leaf path; build spans " << p.build_lines << " lines\n";
+    }
+    if (!r.work.empty()) {
+      os << "\t\twork per element: compares " << r.work[0] << ", moves " << r.work[1]
+         << ", levels " << r.work[2] << ", allocations " << r.work[3] << '\n';
+    }
+    if (!r.latency.empty()) {
+      os << "\t\tlatency per operation: p50 " << r.latency[0] << " ns, p99 "
+         << r.latency[1] << " ns, p99.9 " << r.latency[2] << " ns, max "
+         << r.latency[3] << " ns\n";
+    }
+    report_depths(r, os);
+  }
+}
+
+// Side-by-side table per scenario: each layout at its first offset and at its
+// fastest offset, as throughput relative to the baseline layout.
+void report_comparison(const std::vector<BenchResult>& results,
+                       const std::string& baseline, std::ostream& os) {
+  std::vector<bool> done(results.size());
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    if (done[i]) continue;
+    const auto& scenario = results[i];
+    os << "Throughput relative to " << baseline << " (higher is faster): "
+       << scenario.type << ' ' << scenario.op << " on " << scenario.size << ' '
+       << scenario.input << " keys, " << scenario.threads << " thread(s)\n";
+    for (std::size_t j = i; j < results.size(); ++j) {
+      if (done[j] || !same_scenario(scenario, results[j])) continue;
+      const BenchResult* first = &results[j];
+      const BenchResult* best = first;
+      for (std::size_t k = j; k < results.size(); ++k) {
+        if (same_scenario(scenario, results[k]) && results[k].layout == first->layout) {
+          if (results[k].summary.median < best->summary.median) best = &results[k];
+          done[k] = true;
+        }
+      }
+      auto print = [&os](const BenchResult& r) {
+        os << "offset " << r.offset << ' ' << r.summary.median * 1e9 / r.size
+           << " ns/element (";
+        if (r.vs_baseline > 0) {
+          os << r.vs_baseline << "x)";
+        } else {
+          os << "no baseline run)";
+        }
+      };
+      os << '\t' << first->layout << ": ";
+      print(*first);
+      if (best != first) {
+        os << ", best ";
+        print(*best);
+      }
+      os << '\n';
+    }
+  }
+}
+
+// Size sweep: one row per heap size, one column per layout holding its fastest
+// offset's ns/element, annotated with the cache level the heap fits in.
+void report_sweep(const std::vector<BenchResult>& results, const BenchOptions& opt,
+                  std::ostream& os) {
+  for (const auto& type : opt.types) {
+    for (const auto& op : opt.ops) {
+      for (const auto& input : opt.inputs) {
+        for (const auto threads : opt.threads) {
+          os << "Size sweep: " << type << ' ' << op << " on " << input << " keys, "
+             << threads << " thread(s); ns/element at the best offset ("
+             << describe_caches(opt.caches) << ")\n";
+          os << std::setw(12) << "size" << std::setw(12) << "bytes" << std::setw(6) << "fits";
+          for (const auto& layout : opt.layouts) os << std::setw(18) << layout;
+          os << '\n';
+          for (const auto size : opt.sizes) {
+            std::ostringstream row;
+            bool any = false;
+            std::string fits;
+            std::size_t bytes = 0;
+            for (const auto& layout : opt.layouts) {
+              const BenchResult* best = nullptr;
+              for (const auto& r : results) {
+                if (r.type == type && r.op == op && r.input == input &&
+                    r.threads == threads && r.size == size && r.layout == layout &&
+                    (!best || r.summary.median < best->summary.median)) {
+                  best = &r;
+                }
+              }
+              std::ostringstream cell;
+              if (best) {
+                any = true;
+                fits = best->fits;
+                bytes = best->bytes;
+                cell << std::setprecision(3) << best->summary.median * 1e9 / size
+                     << " @" << best->offset;
+              } else {
+                cell << '-';
+              }
+              row << std::setw(18) << cell.str();
+            }
+            if (!any) continue;
+            os << std::setw(12) << size << std::setw(12) << format_bytes(bytes)
+               << std::setw(6) << fits << row.str() << '\n';
+          }
+        }
+      }
+    }
+  }
+}
+
+// Element-size matrix: one row per element type, one column per offset, each
+// cell the median relative to the row's first offset; * marks the fastest.
+void report_matrix(const std::vector<BenchResult>& results, const BenchOptions& opt,
+                   std::ostream& os) {
+  std::vector<bool> done(results.size());
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto& key = results[i];
+    if (done[i] || key.offset != opt.offsets.front()) continue;
+    // Layouts without offsets (the std baselines) have nothing to tabulate.
+    const bool has_offsets = std::any_of(results.begin(), results.end(), [&](const BenchResult& r) {
+      return r.layout == key.layout && r.offset != key.offset;
+    });
+    if (!has_offsets) continue;
+    os << "Offset matrix: " << key.layout << ' ' << key.op << " on " << key.size << ' '
+       << key.input << " keys, " << key.threads << " thread(s); median relative to offset "
+       << key.offset << '\n';
+    os << std::setw(12) << "type" << std::setw(7) << "bytes";
+    for (const auto offset : opt.offsets) os << std::setw(8) << offset;
+    os << '\n';
+    for (std::size_t j = i; j < results.size(); ++j) {
+      const auto& row = results[j];
+      if (done[j] || row.offset != key.offset || row.layout != key.layout ||
+          row.op != key.op || row.input != key.input || row.size != key.size ||
+          row.threads != key.threads) {
+        continue;
+      }
+      std::vector<const BenchResult*> cells;
+      const BenchResult* best = &row;
+      for (std::size_t k = j; k < results.size(); ++k) {
+        const auto& r = results[k];
+        if (r.type == row.type && r.layout == row.layout && r.op == row.op &&
+            r.input == row.input && r.size == row.size && r.threads == row.threads) {
+          cells.push_back(&r);
+          done[k] = true;
+          if (r.summary.median < best->summary.median) best = &r;
+        }
+      }
+      os << std::setw(12) << row.type << std::setw(7) << row.element_bytes;
+      for (const auto* c : cells) {
+        std::ostringstream cell;
+        cell << std::fixed << std::setprecision(3) << c->relative << (c == best ? "*" : " ");
+        os << std::setw(8) << cell.str();
+      }
+      os << '\n';
+    }
+  }
+}
+
+void report_csv(const std::vector<BenchResult>& results, const BenchOptions& opt,
+                std::ostream& os) {
+  const auto sim_names = sim_level_names(opt.sim);
+  os << "type,element_bytes,layout,arity,op,input,size,bytes,fits,offset,threads,samples,batch,outliers,"
+        "median_s,mean_s,p90_s,p99_s,stddev_s,ci_low_s,ci_high_s,"
+        "ns_per_element,ns_per_op,relative,within_noise,vs_baseline";
+  for (int e = 0; e < PerfCounters::kNumEvents; ++e) {
+    os << ',' << PerfCounters::name(static_cast<PerfCounters::Event>(e)) << "_per_element";
+  }
+  if (opt.work) {
+    os << ",compares_per_element,moves_per_element,levels_per_element,allocs_per_element";
+  }
+  if (opt.latency) os << ",latency_p50_ns,latency_p99_ns,latency_p999_ns,latency_max_ns";
+  if (opt.depths) {
+    for (const auto op : {HeapOp::kPush, HeapOp::kPop, HeapOp::kUpdate}) {
+      os << ",depth_" << op_name(op) << "_mean,depth_" << op_name(op) << "_within_1";
+    }
+  }
+  if (opt.simulate) {
+    os << ",sim_accesses_per_element";
+    for (const auto& name : sim_names) os << ",sim_" << name << "_misses_per_element";
+  }
+  os << '\n';
+  for (const auto& r : results) {
+    const Summary& s = r.summary;
+    os << r.type << ',' << r.element_bytes << ',' << r.layout << ',' << r.arity << ',' << r.op << ','
+       << r.input << ',' << r.size << ',' << r.bytes << ',' << r.fits << ','
+       << r.offset << ',' << r.threads << ',' << r.samples.size() << ',' << r.batch << ',' << s.outliers << ',' << s.median << ',' << s.mean
+       << ',' << s.p90 << ',' << s.p99 << ',' << s.stddev << ',' << s.ci_low << ','
+       << s.ci_high << ',' << s.median * 1e9 / r.size << ','
+       << s.median * 1e9 / r.ops_per_run << ',' << r.relative << ','
+       << r.within_noise << ',' << r.vs_baseline;
+    for (int e = 0; e < PerfCounters::kNumEvents; ++e) {
+      os << ',';
+      if (!r.counters.empty() && r.counters[e] >= 0) os << r.counters[e];
+    }
+    if (opt.work) {
+      for (std::size_t k = 0; k < 4; ++k) {
+        os << ',';
+        if (!r.work.empty()) os << r.work[k];
+      }
+    }
+    if (opt.latency) {
+      for (std::size_t k = 0; k < 4; ++k) {
+        os << ',';
+        if (!r.latency.empty()) os << r.latency[k];
+      }
+    }
+    if (opt.depths) {
+      for (const auto op : {HeapOp::kPush, HeapOp::kPop, HeapOp::kUpdate}) {
+        const bool any = !r.depths.empty() && r.depths[static_cast<int>(op)].count() > 0;
+        os << ',';
+        if (any) os << r.depths[static_cast<int>(op)].mean();
+        os << ',';
+        if (any) os << r.depths[static_cast<int>(op)].share_within(1);
+      }
+    }
+    if (opt.simulate) {
+      os << ',' << r.sim_accesses;
+      for (const auto m : r.sim_misses) os << ',' << m;
+    }
+    os << '\n';
+  }
+}
+
+void report_json(const std::vector<BenchResult>& results, const BenchOptions& opt,
+                 std::ostream& os) {
+  const auto sim_names = sim_level_names(opt.sim);
+  os << "[\n";
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    const auto& r = results[i];
+    const Summary& s = r.summary;
+    os << "  {\"type\": \"" << r.type << "\", \"element_bytes\": " << r.element_bytes
+       << ", \"layout\": \"" << r.layout
+       << "\", \"arity\": " << r.arity << ", \"op\": \"" << r.op
+       << "\", \"input\": \"" << r.input << "\", \"size\": " << r.size
+       << ", \"bytes\": " << r.bytes << ", \"fits\": \"" << r.fits << '"' << ", \"offset\": " << r.offset
+       << ", \"threads\": " << r.threads << ", \"samples\": " << r.samples.size()
+       << ", \"batch\": " << r.batch << ", \"outliers\": " << s.outliers
+       << ", \"median_s\": " << s.median << ", \"mean_s\": " << s.mean
+       << ", \"p90_s\": " << s.p90 << ", \"p99_s\": " << s.p99
+       << ", \"stddev_s\": " << s.stddev << ", \"ci_low_s\": " << s.ci_low
+       << ", \"ci_high_s\": " << s.ci_high << ", \"ns_per_element\": "
+       << s.median * 1e9 / r.size << ", \"ns_per_op\": "
+       << s.median * 1e9 / r.ops_per_run << ", \"relative\": " << r.relative
+       << ", \"within_noise\": " << (r.within_noise ? "true" : "false")
+       << ", \"vs_baseline\": " << r.vs_baseline;
+    if (!r.counters.empty()) {
+      os << ", \"counters_per_element\": {";
+      for (int e = 0; e < PerfCounters::kNumEvents; ++e) {
+        os << (e ? ", \"" : "\"") << PerfCounters::name(static_cast<PerfCounters::Event>(e))
+           << "\": ";
+        if (r.counters[e] >= 0) {
+          os << r.counters[e];
+        } else {
+          os << "null";
+        }
+      }
+      os << '}';
+    }
+    if (!r.work.empty()) {
+      os << ", \"work_per_element\": {\"compares\": " << r.work[0]
+         << ", \"moves\": " << r.work[1] << ", \"levels\": " << r.work[2]
+         << ", \"allocs\": " << r.work[3] << '}';
+    }
+    if (!r.latency.empty()) {
+      os << ", \"latency_ns\": {\"p50\": " << r.latency[0] << ", \"p99\": " << r.latency[1]
+         << ", \"p99.9\": " << r.latency[2] << ", \"max\": " << r.latency[3] << '}';
+    }
+    if (!r.depths.empty()) {
+      // Counts per depth, from 0 up to the deepest recorded.
+      os << ", \"sift_depths\": {";
+      const char* sep = "";
+      for (int i = 0; i < kNumHeapOps; ++i) {
+        const auto& h = r.depths[i];
+        if (h.count() == 0) continue;
+        std::size_t deepest = DepthHistogram::kMaxDepth;
+        while (h.at(deepest) == 0) --deepest;
+        os << sep << '"' << op_name(static_cast<HeapOp>(i)) << "\": [";
+        for (std::size_t d = 0; d <= deepest; ++d) os << (d ? ", " : "") << h.at(d);
+        os << ']';
+        sep = ", ";
+      }
+      os << '}';
+    }
+    if (!r.sim_misses.empty()) {
+      os << ", \"sim_accesses_per_element\": " << r.sim_accesses
+         << ", \"sim_misses_per_element\": {";
+      for (std::size_t l = 0; l < sim_names.size(); ++l) {
+        os << (l ? ", \"" : "\"") << sim_names[l] << "\": " << r.sim_misses[l];
+      }
+      os << '}';
+    }
+    os << "}"
+       << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  os << "]\n";
+}
+
+void report_hold(const std::vector<HoldResult>& results, const std::string& format,
+                 std::ostream& os) {
+  if (format == "csv") {
+    os << "type,layout,increments,size,offset,ops,mean_ns,p50_ns,p99_ns,p999_ns,max_ns\n";
+    for (const auto& r : results) {
+      os << r.type << ',' << r.layout << ',' << r.increments << ',' << r.size << ','
+         << r.offset << ',' << r.ops << ',' << r.mean_ns;
+      for (const auto l : r.latency) os << ',' << l;
+      os << '\n';
+    }
+  } else if (format == "json") {
+    os << "[\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      const auto& r = results[i];
+      os << "  {\"type\": \"" << r.type << "\", \"layout\": \"" << r.layout
+         << "\", \"increments\": \"" << r.increments << "\", \"size\": " << r.size
+         << ", \"offset\": " << r.offset << ", \"ops\": " << r.ops
+         << ", \"mean_ns\": " << r.mean_ns << ", \"p50_ns\": " << r.latency[0]
+         << ", \"p99_ns\": " << r.latency[1] << ", \"p999_ns\": " << r.latency[2]
+         << ", \"max_ns\": " << r.latency[3] << '}'
+         << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "]\n";
+  } else {
+    const HoldResult* group = nullptr;
+    for (const auto& r : results) {
+      if (!group || group->type != r.type || group->size != r.size ||
+          group->increments != r.increments) {
+        group = &r;
+        os << "Hold model: " << r.type << ", " << r.size << " elements, " << r.increments
+           << " increments, " << r.ops << " steps after " << kHoldWarmupFactor * r.size
+           << " warmup steps; ns per pop + push\n";
+      }
+      os << '\t' << r.layout << " offset " << r.offset << ": mean " << r.mean_ns << ", p50 "
+         << r.latency[0] << ", p99 " << r.latency[1] << ", p99.9 " << r.latency[2]
+         << ", max " << r.latency[3] << '\n';
+    }
+  }
+}
+
+void report_graphs(const std::vector<GraphResult>& results, const std::string& format,
+                   std::ostream& os) {
+  if (format == "csv") {
+    os << "graph,algorithm,vertices,edges,layout,offset,pushes,pops,decreases,checksum,"
+          "samples,median_s,mean_s,ci_low_s,ci_high_s,ns_per_heap_op\n";
+    for (const auto& r : results) {
+      const Summary& s = r.summary;
+      os << r.graph << ',' << r.algorithm << ',' << r.vertices << ',' << r.edges << ','
+         << r.layout << ',' << r.offset << ',' << r.counts.pushes << ',' << r.counts.pops << ','
+         << r.counts.decreases << ',' << r.counts.checksum << ',' << r.samples.size() << ','
+         << s.median << ',' << s.mean << ',' << s.ci_low << ',' << s.ci_high << ','
+         << s.median * 1e9 / r.counts.ops() << '\n';
+    }
+  } else if (format == "json") {
+    os << "[\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      const auto& r = results[i];
+      const Summary& s = r.summary;
+      os << "  {\"graph\": \"" << r.graph << "\", \"algorithm\": \"" << r.algorithm
+         << "\", \"vertices\": " << r.vertices << ", \"edges\": " << r.edges
+         << ", \"layout\": \"" << r.layout << "\", \"offset\": " << r.offset
+         << ", \"pushes\": " << r.counts.pushes << ", \"pops\": " << r.counts.pops
+         << ", \"decreases\": " << r.counts.decreases
+         << ", \"checksum\": " << r.counts.checksum << ", \"median_s\": " << s.median
+         << ", \"mean_s\": " << s.mean << ", \"ci_low_s\": " << s.ci_low
+         << ", \"ci_high_s\": " << s.ci_high << ", \"ns_per_heap_op\": "
+         << s.median * 1e9 / r.counts.ops() << '}'
+         << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "]\n";
+  } else {
+    const GraphResult* group = nullptr;
+    for (const auto& r : results) {
+      if (!group || group->graph != r.graph || group->algorithm != r.algorithm ||
+          group->vertices != r.vertices) {
+        group = &r;
+        os << "Graph search: " << r.algorithm << " on " << r.graph << ", " << r.vertices
+           << " vertices, " << r.edges << " edges; " << r.counts.pushes << " pushes, "
+           << r.counts.pops << " pops";
+        if (r.counts.decreases) os << ", " << r.counts.decreases << " decreases";
+        os << " per search\n";
+      }
+      const Summary& s = r.summary;
+      os << '\t' << r.layout << " offset " << r.offset << ": median " << s.median
+         << " s (95% CI " << s.ci_low << " - " << s.ci_high << "), "
+         << s.median * 1e9 / r.counts.ops() << " ns per heap operation";
+      if (r.counts != group->counts) {
+        os << " (" << r.counts.pushes << " pushes, " << r.counts.pops << " pops, "
+           << r.counts.decreases << " decreases)";
+      }
+      os << '\n';
+    }
+  }
+}
+
+void report_metrics(const MetricsSnapshot& m, const std::string& format, std::ostream& os) {
+  if (format == "csv") {
+    os << "size,builds,pushes,pops,updates,rebuilds,ops_per_sec,published_ns,publishes";
+    for (int b = 0; b < kMetricsLatencyBuckets; ++b) os << ",latency_ge_" << (1ull << b) << "_ns";
+    os << '\n' << m.size;
+    for (const auto n : m.ops) os << ',' << n;
+    os << ',' << m.rebuilds << ',' << m.ops_per_sec << ',' << m.published_ns << ','
+       << m.publishes;
+    for (const auto n : m.latency) os << ',' << n;
+    os << '\n';
+  } else if (format == "json") {
+    os << "{\"size\": " << m.size;
+    for (int i = 0; i < kNumHeapOps; ++i) {
+      os << ", \"" << op_name(static_cast<HeapOp>(i)) << "\": " << m.ops[i];
+    }
+    os << ", \"rebuilds\": " << m.rebuilds << ", \"ops_per_sec\": " << m.ops_per_sec
+       << ", \"published_ns\": " << m.published_ns << ", \"publishes\": " << m.publishes
+       << ", \"latency_log2_ns\": [";
+    for (int b = 0; b < kMetricsLatencyBuckets; ++b) os << (b ? ", " : "") << m.latency[b];
+    os << "]}\n";
+  } else {
+    os << "Metrics (publish " << m.publishes << "): " << m.size << " elements, "
+       << m.ops_per_sec << " ops/s;";
+    for (int i = 0; i < kNumHeapOps; ++i) {
+      os << (i ? ", " : " ") << op_name(static_cast<HeapOp>(i)) << ' ' << m.ops[i];
+    }
+    os << "; " << m.rebuilds << " rebuild(s)\n\tsampled latency:";
+    for (int b = 0; b < kMetricsLatencyBuckets; ++b) {
+      if (m.latency[b]) os << ' ' << (1ull << b) << "+ ns " << m.latency[b];
+    }
+    os << '\n';
+  }
+}
+
+void report_stats(const std::vector<StatsResult>& results, const std::string& format,
+                  std::ostream& os) {
+  if (format == "csv") {
+    os << "type,layout,size,capacity,element_bytes,bytes,alignment,offset,offset_bytes,depth,"
+          "line,sibling_groups,straddling_groups\n";
+    for (const auto& r : results) {
+      const auto& s = r.stats;
+      os << r.type << ',' << r.layout << ',' << s.size << ',' << s.capacity << ','
+         << s.element_bytes << ',' << s.bytes << ',' << s.alignment << ',' << s.offset << ','
+         << s.offset_bytes << ',' << s.depth << ',' << s.line << ',' << s.sibling_groups << ','
+         << s.straddling_groups << '\n';
+    }
+  } else if (format == "json") {
+    os << "[\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      const auto& r = results[i];
+      const auto& s = r.stats;
+      os << "  {\"type\": \"" << r.type << "\", \"layout\": \"" << r.layout
+         << "\", \"size\": " << s.size << ", \"capacity\": " << s.capacity
+         << ", \"element_bytes\": " << s.element_bytes << ", \"bytes\": " << s.bytes
+         << ", \"alignment\": " << s.alignment << ", \"offset\": " << s.offset
+         << ", \"offset_bytes\": " << s.offset_bytes << ", \"depth\": " << s.depth
+         << ", \"line\": " << s.line << ", \"sibling_groups\": " << s.sibling_groups
+         << ", \"straddling_groups\": " << s.straddling_groups << '}'
+         << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "]\n";
+  } else {
+    const StatsResult* group = nullptr;
+    for (const auto& r : results) {
+      const auto& s = r.stats;
+      if (!group || group->type != r.type || group->stats.size != s.size) {
+        group = &r;
+        os << "Layout: " << r.type << " (" << s.element_bytes << " B), " << s.size
+           << " elements, depth " << s.depth << ", " << s.line << " B lines\n";
+      }
+      os << '\t' << r.layout << " offset " << s.offset << ": " << s.bytes << " B for "
+         << s.capacity << " slots, base aligned to " << s.alignment << ", root at byte "
+         << s.offset_bytes << ", " << s.straddling_groups << " of " << s.sibling_groups
+         << " sibling groups straddle lines\n";
+    }
+  }
+}
+
+void report_model(const std::vector<ModelResult>& results, const std::string& format,
+                  std::ostream& os) {
+  if (format == "csv") {
+    os << "type,element_bytes,arity,size,offset,base,line,page,depth,path_lines,path_pages,"
+          "build_lines,build_pages\n";
+    for (const auto& r : results) {
+      const auto& m = r.model;
+      const auto& p = r.prediction;
+      os << r.type << ',' << m.element_bytes << ',' << m.arity << ',' << r.size << ','
+         << m.offset << ',' << m.base << ',' << m.line << ',' << m.page << ',' << p.depth << ','
+         << p.path_lines << ',' << p.path_pages << ',' << p.build_lines << ',' << p.build_pages
+         << '\n';
+    }
+  } else if (format == "json") {
+    os << "[\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      const auto& r = results[i];
+      const auto& m = r.model;
+      const auto& p = r.prediction;
+      os << "  {\"type\": \"" << r.type << "\", \"element_bytes\": " << m.element_bytes
+         << ", \"arity\": " << m.arity << ", \"size\": " << r.size
+         << ", \"offset\": " << m.offset << ", \"base\": " << m.base
+         << ", \"line\": " << m.line << ", \"page\": " << m.page
+         << ", \"depth\": " << p.depth << ", \"path_lines\": " << p.path_lines
+         << ", \"path_pages\": " << p.path_pages << ", \"build_lines\": " << p.build_lines
+         << ", \"build_pages\": " << p.build_pages << '}'
+         << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "]\n";
+  } else {
+    const ModelResult* group = nullptr;
+    for (const auto& r : results) {
+      const auto& m = r.model;
+      const auto& p = r.prediction;
+      if (!group || group->type != r.type || group->model.arity != m.arity ||
+          group->size != r.size) {
+        group = &r;
+        os << "Layout model: " << r.type << " (" << m.element_bytes << " B), arity " << m.arity
+           << ", " << r.size << " elements, depth " << p.depth << "; array at byte " << m.base
+           << ", " << m.line << " B lines, " << m.page << " B pages\n";
+      }
+      os << "\toffset " << m.offset << ": " << p.path_lines << " lines and " << p.path_pages
+         << " pages per root-to-leaf path; build spans " << p.build_lines << " lines and "
+         << p.build_pages << " pages\n";
+    }
+  }
+}
+
+void report_scaling(const std::vector<ScalingResult>& results, const std::string& format,
+                    std::ostream& os) {
+  auto minmax = [](const ScalingResult& r) {
+    return std::minmax_element(r.per_thread.begin(), r.per_thread.end());
+  };
+  if (format == "csv") {
+    os << "type,frontend,op,input,size,threads,placement,sockets,total_ops_per_s,speedup,"
+          "fairness,min_thread_ops_per_s,max_thread_ops_per_s,per_thread_ops_per_s\n";
+    for (const auto& r : results) {
+      const auto mm = minmax(r);
+      os << r.type << ',' << r.frontend << ',' << r.op << ',' << r.input << ',' << r.size
+         << ',' << r.threads << ',' << r.placement << ',' << r.sockets << ',' << r.total
+         << ',' << r.speedup << ',' << r.fairness << ',' << *mm.first << ',' << *mm.second
+         << ',';
+      for (std::size_t t = 0; t < r.per_thread.size(); ++t) {
+        os << (t ? ";" : "") << r.per_thread[t];
+      }
+      os << '\n';
+    }
+  } else if (format == "json") {
+    os << "[\n";
+    for (std::size_t i = 0; i < results.size(); ++i) {
+      const auto& r = results[i];
+      os << "  {\"type\": \"" << r.type << "\", \"frontend\": \"" << r.frontend
+         << "\", \"op\": \"" << r.op << "\", \"input\": \"" << r.input
+         << "\", \"size\": " << r.size << ", \"threads\": " << r.threads
+         << ", \"placement\": \"" << r.placement << "\", \"sockets\": " << r.sockets
+         << ", \"total_ops_per_s\": " << r.total << ", \"speedup\": " << r.speedup
+         << ", \"fairness\": " << r.fairness << ", \"per_thread_ops_per_s\": [";
+      for (std::size_t t = 0; t < r.per_thread.size(); ++t) {
+        os << (t ? ", " : "") << r.per_thread[t];
+      }
+      os << "]}" << (i + 1 < results.size() ? ",\n" : "\n");
+    }
+    os << "]\n";
+  } else {
+    const ScalingResult* group = nullptr;
+    for (const auto& r : results) {
+      if (!group || group->type != r.type || group->op != r.op || group->input != r.input ||
+          group->size != r.size || group->placement != r.placement) {
+        group = &r;
+        os << "Scaling: " << r.type << ' ' << r.op << " on " << r.size << ' ' << r.input
+           << " keys, threads " << (r.placement == "none" ? "unpinned" : "pinned " + r.placement)
+           << '\n';
+      }
+      const auto mm = minmax(r);
+      os << '\t' << r.frontend << ", " << r.threads << " thread(s)";
+      if (r.sockets) os << " on " << r.sockets << " socket(s)";
+      os << ": " << r.total / 1e6 << " Mops/s";
+      if (r.speedup > 0) os << " (" << r.speedup << "x of 1 thread)";
+      os << ", per thread " << *mm.first / 1e6 << " - " << *mm.second / 1e6
+         << " Mops/s, fairness " << r.fairness << '\n';
+    }
+  }
+}
+
+//
+// Baseline store: summaries saved per host, compiler and build flags, and
+// compared against later runs
+//
+
+#ifndef HEAP_BUILD_FLAGS
+#define HEAP_BUILD_FLAGS "unknown"
+#endif
+
+// Minimal JSON document model, enough for the baseline store.
+struct Json {
+  enum Kind { kNull, kBool, kNumber, kString, kArray, kObject };
+
+  Kind kind = kNull;
+  bool boolean = false;
+  double number = 0;
+  std::string string;
+  std::vector<Json> array;
+  std::vector<std::pair<std::string, Json>> object;  // in document order
+
+  static Json Number(double d) {
+    Json j;
+    j.kind = kNumber;
+    j.number = d;
+    return j;
+  }
+  static Json String(std::string v) {
+    Json j;
+    j.kind = kString;
+    j.string = std::move(v);
+    return j;
+  }
+
+  // Member named key, or nullptr if absent or not an object.
+  const Json* find(const std::string& key) const {
+    for (const auto& member : object) {
+      if (member.first == key) return &member.second;
+    }
+    return nullptr;
+  }
+  // Member named key; throws std::runtime_error if absent.
+  const Json& at(const std::string& key) const {
+    const Json* j = find(key);
+    if (!j) throw std::runtime_error("JSON: missing \"" + key + "\"");
+    return *j;
+  }
+};
+
+// Recursive-descent parser for RFC 8259 JSON. \\u escapes outside ASCII
+// become '?'. Throws std::runtime_error on malformed input.
+class JsonParser {
+ public:
+  explicit JsonParser(const std::string& text) : text_(text) {}
+
+  Json Parse() {
+    Json j = value();
+    skip_space();
+    if (pos_ != text_.size()) fail("trailing characters");
+    return j;
+  }
+
+ private:
+  Json value() {
+    skip_space();
+    if (pos_ >= text_.size()) fail("unexpected end");
+    const char c = text_[pos_];
+    Json j;
+    if (c == '{') {
+      j.kind = Json::kObject;
+      ++pos_;
+      if (consume('}')) return j;
+      do {
+        skip_space();
+        std::string key = string();
+        skip_space();
+        expect(':');
+        j.object.emplace_back(std::move(key), value());
+        skip_space();
+      } while (consume(','));
+      expect('}');
+    } else if (c == '[') {
+      j.kind = Json::kArray;
+      ++pos_;
+      skip_space();
+      if (consume(']')) return j;
+      do {
+        j.array.push_back(value());
+        skip_space();
+      } while (consume(','));
+      expect(']');
+    } else if (c == '"') {
+      j = Json::String(string());
+    } else if (literal("true")) {
+      j.kind = Json::kBool;
+      j.boolean = true;
+    } else if (literal("false")) {
+      j.kind = Json::kBool;
+    } else if (literal("null")) {
+    } else {
+      const char* begin = text_.c_str() + pos_;
+      char* end = nullptr;
+      const double d = std::strtod(begin, &end);
+      if (end == begin) fail("unexpected character");
+      pos_ += end - begin;
+      j = Json::Number(d);
+    }
+    return j;
+  }
+
+  std::string string() {
+    expect('"');
+    std::string out;
+    while (true) {
+      if (pos_ >= text_.size()) fail("unterminated string");
+      const char c = text_[pos_++];
+      if (c == '"') return out;
+      if (c != '\\') {
+        out += c;
+        continue;
+      }
+      if (pos_ >= text_.size()) fail("unterminated string");
+      const char e = text_[pos_++];
+      switch (e) {
+        case 'b': out += '\b'; break;
+        case 'f': out += '\f'; break;
+        case 'n': out += '\n'; break;
+        case 'r': out += '\r'; break;
+        case 't': out += '\t'; break;
+        case 'u': {
+          if (pos_ + 4 > text_.size()) fail("bad \\u escape");
+          const unsigned long code = std::stoul(text_.substr(pos_, 4), nullptr, 16);
+          pos_ += 4;
+          out += code < 0x80 ? static_cast<char>(code) : '?';
+          break;
+        }
+        default: out += e;
+      }
+    }
+  }
+
+  void skip_space() {
+    while (pos_ < text_.size() && std::isspace(static_cast<unsigned char>(text_[pos_]))) ++pos_;
+  }
+  bool consume(char c) {
+    skip_space();
+    if (pos_ < text_.size() && text_[pos_] == c) {
+      ++pos_;
+      return true;
+    }
+    return false;
+  }
+  void expect(char c) {
+    if (!consume(c)) fail(std::string("expected '") + c + "'");
+  }
+  bool literal(const char* word) {
+    const std::size_t n = std::strlen(word);
+    if (text_.compare(pos_, n, word) != 0) return false;
+    pos_ += n;
+    return true;
+  }
+  [[noreturn]] void fail(const std::string& what) {
+    throw std::runtime_error("JSON: " + what + " at offset " + std::to_string(pos_));
+  }
+
+  const std::string& text_;
+  std::size_t pos_ = 0;
+};
+
+void write_json_string(const std::string& s, std::ostream& os) {
+  os << '"';
+  for (const char c : s) {
+    if (c == '"' || c == '\\') {
+      os << '\\' << c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      os << "\\u" << std::hex << std::setw(4) << std::setfill('0') << int(c) << std::dec
+         << std::setfill(' ');
+    } else {
+      os << c;
+    }
+  }
+  os << '"';
+}
+
+// Writes j with arrays of objects or arrays one element per line.
+void write_json(const Json& j, std::ostream& os, int depth = 0) {
+  switch (j.kind) {
+    case Json::kNull: os << "null"; break;
+    case Json::kBool: os << (j.boolean ? "true" : "false"); break;
+    case Json::kNumber: os << std::setprecision(17) << j.number << std::setprecision(6); break;
+    case Json::kString: write_json_string(j.string, os); break;
+    case Json::kArray: {
+      const bool nested = !j.array.empty() && j.array[0].kind >= Json::kArray;
+      os << '[';
+      for (std::size_t i = 0; i < j.array.size(); ++i) {
+        os << (i ? "," : "") << (nested ? "\n" + std::string(2 * depth + 2, ' ') : " ");
+        write_json(j.array[i], os, depth + 1);
+      }
+      if (!j.array.empty()) os << (nested ? "\n" + std::string(2 * depth, ' ') : " ");
+      os << ']';
+      break;
+    }
+    case Json::kObject:
+      os << '{';
+      for (std::size_t i = 0; i < j.object.size(); ++i) {
+        os << (i ? ", " : "");
+        write_json_string(j.object[i].first, os);
+        os << ": ";
+        write_json(j.object[i].second, os, depth + 1);
+      }
+      os << '}';
+      break;
+  }
+}
+
+// What a baseline is keyed by: results only compare on the same CPU model,
+// compiler and flags.
+struct HostKey {
+  std::string cpu;
+  std::string compiler;
+  std::string flags;
+
+  bool operator==(const HostKey& other) const {
+    return cpu == other.cpu && compiler == other.compiler && flags == other.flags;
+  }
+};
+
+HostKey this_host() {
+  HostKey key{"unknown", "", HEAP_BUILD_FLAGS};
+  std::ifstream cpuinfo("/proc/cpuinfo");
+  for (std::string line; std::getline(cpuinfo, line);) {
+    if (line.compare(0, 10, "model name") != 0) continue;
+    const auto colon = line.find(':');
+    if (colon != std::string::npos) key.cpu = line.substr(line.find_first_not_of(' ', colon + 1));
+    break;
+  }
+#if defined(__clang__)
+  key.compiler = "clang " __clang_version__;
+#elif defined(__GNUC__)
+  key.compiler = "gcc " __VERSION__;
+#else
+  key.compiler = "unknown";
+#endif
+  return key;
+}
+
+std::string describe_host(const HostKey& key) {
+  return key.cpu + ", " + key.compiler + ", flags " + key.flags;
+}
+
+// Reads the store at path; a missing file is an empty store.
+Json load_store(const std::string& path) {
+  std::ifstream in(path);
+  Json store;
+  store.kind = Json::kObject;
+  if (!in) return store;
+  std::ostringstream text;
+  text << in.rdbuf();
+  store = JsonParser(text.str()).Parse();
+  if (store.kind != Json::kObject || !store.find("baselines")) {
+    throw std::runtime_error(path + " is not a baseline store");
+  }
+  return store;
+}
+
+// The store's baselines for key, or nullptr if it has none.
+const Json* find_baseline(const Json& store, const HostKey& key) {
+  const Json* baselines = store.find("baselines");
+  if (!baselines) return nullptr;
+  for (const auto& b : baselines->array) {
+    if (HostKey{b.at("cpu").string, b.at("compiler").string, b.at("flags").string} == key) {
+      return &b;
+    }
+  }
+  return nullptr;
+}
+
+// Saves results' summaries as this host's baseline in the store at path,
+// replacing any earlier baseline for the same host key.
+void save_baseline(const std::vector<BenchResult>& results, const std::string& path) {
+  Json store = load_store(path);
+  const HostKey key = this_host();
+  Json entry;
+  entry.kind = Json::kObject;
+  entry.object = {{"cpu", Json::String(key.cpu)},
+                  {"compiler", Json::String(key.compiler)},
+                  {"flags", Json::String(key.flags)}};
+  Json list;
+  list.kind = Json::kArray;
+  for (const auto& r : results) {
+    Json j;
+    j.kind = Json::kObject;
+    j.object = {{"type", Json::String(r.type)},
+                {"layout", Json::String(r.layout)},
+                {"op", Json::String(r.op)},
+                {"input", Json::String(r.input)},
+                {"arity", Json::Number(r.arity)},
+                {"size", Json::Number(r.size)},
+                {"offset", Json::Number(r.offset)},
+                {"threads", Json::Number(r.threads)},
+                {"n", Json::Number(r.summary.n)},
+                {"mean_s", Json::Number(r.summary.mean)},
+                {"stddev_s", Json::Number(r.summary.stddev)},
+                {"median_s", Json::Number(r.summary.median)}};
+    list.array.push_back(std::move(j));
+  }
+  entry.object.emplace_back("results", std::move(list));
+  if (!store.find("baselines")) {
+    store.object.emplace_back("baselines", Json());
+    store.object.back().second.kind = Json::kArray;
+  }
+  auto& baselines = std::find_if(store.object.begin(), store.object.end(), [](const auto& m) {
+                      return m.first == "baselines";
+                    })->second;
+  baselines.array.erase(
+      std::remove_if(baselines.array.begin(), baselines.array.end(), [&](const Json& b) {
+        return HostKey{b.at("cpu").string, b.at("compiler").string, b.at("flags").string} == key;
+      }),
+      baselines.array.end());
+  baselines.array.push_back(std::move(entry));
+  std::ofstream out(path);
+  write_json(store, out);
+  out << '\n';
+  if (!out) throw std::runtime_error("error writing baseline store " + path);
+}
+
+// Regularized incomplete beta function I_x(a, b), by Lentz's continued
+// fraction.
+double incomplete_beta(double a, double b, double x) {
+  if (x <= 0) return 0;
+  if (x >= 1) return 1;
+  // The continued fraction converges fast only below the mean.
+  if (x > (a + 1) / (a + b + 2)) return 1 - incomplete_beta(b, a, 1 - x);
+  const double front = std::exp(std::lgamma(a + b) - std::lgamma(a) - std::lgamma(b) +
+                                a * std::log(x) + b * std::log(1 - x)) / a;
+  constexpr double kTiny = 1e-300;
+  double f = 1, c = 1, d = 0;
+  for (int i = 0; i <= 400; ++i) {
+    const int m = i / 2;
+    double numerator;
+    if (i == 0) {
+      numerator = 1;
+    } else if (i % 2 == 0) {
+      numerator = m * (b - m) * x / ((a + 2 * m - 1) * (a + 2 * m));
+    } else {
+      numerator = -(a + m) * (a + b + m) * x / ((a + 2 * m) * (a + 2 * m + 1));
+    }
+    d = 1 + numerator * d;
+    if (std::abs(d) < kTiny) d = kTiny;
+    d = 1 / d;
+    c = 1 + numerator / c;
+    if (std::abs(c) < kTiny) c = kTiny;
+    const double delta = c * d;
+    f *= delta;
+    if (std::abs(1 - delta) < 1e-12) break;
+  }
+  return front * (f - 1);
+}
+
+// Two-sided p-value of Welch's t-test for a difference in means.
+double welch_p_value(double mean1, double sd1, double n1, double mean2, double sd2, double n2) {
+  if (n1 < 2 || n2 < 2) return 1;
+  const double v1 = sd1 * sd1 / n1, v2 = sd2 * sd2 / n2;
+  if (v1 + v2 == 0) return mean1 == mean2 ? 1 : 0;
+  const double t = (mean1 - mean2) / std::sqrt(v1 + v2);
+  const double df = (v1 + v2) * (v1 + v2) / (v1 * v1 / (n1 - 1) + v2 * v2 / (n2 - 1));
+  return incomplete_beta(df / 2, 0.5, df / (df + t * t));
+}
+
+// Compares results with this host's baseline in the store at path. Prints a
+// line per matched scenario and returns the number of regressions: scenarios
+// whose mean grew by more than opt.threshold at significance opt.alpha.
+std::size_t compare_baseline(const std::vector<BenchResult>& results, const BenchOptions& opt,
+                             std::ostream& os) {
+  const Json store = load_store(opt.compare);
+  const HostKey key = this_host();
+  const Json* baseline = find_baseline(store, key);
+  if (!baseline) {
+    throw std::runtime_error("no baseline for " + describe_host(key) + " in " + opt.compare);
+  }
+  os << "Compared with the baseline for " << describe_host(key) << " (regression: mean "
+     << opt.threshold * 100 << "% slower at p < " << opt.alpha << ")\n";
+  std::size_t regressions = 0, matched = 0;
+  for (const auto& r : results) {
+    for (const auto& b : baseline->at("results").array) {
+      if (b.at("type").string != r.type || b.at("layout").string != r.layout ||
+          b.at("op").string != r.op || b.at("input").string != r.input ||
+          b.at("arity").number != r.arity || b.at("size").number != r.size || b.at("offset").number != r.offset ||
+          b.at("threads").number != r.threads) {
+        continue;
+      }
+      ++matched;
+      const double old_mean = b.at("mean_s").number;
+      const double p = welch_p_value(r.summary.mean, r.summary.stddev, r.summary.n, old_mean,
+                                     b.at("stddev_s").number, b.at("n").number);
+      const double change = r.summary.mean / old_mean - 1;
+      const char* verdict = "unchanged";
+      if (p < opt.alpha && change > opt.threshold) {
+        verdict = "REGRESSION";
+        ++regressions;
+      } else if (p < opt.alpha && change < -opt.threshold) {
+        verdict = "faster";
+      }
+      os << '\t' << r.type << ' ' << r.layout << ' ' << r.op << " on " << r.size << ' '
+         << r.input << " keys, offset " << r.offset << ", " << r.threads << " thread(s): "
+         << std::showpos << change * 100 << std::noshowpos << "% mean, p " << p << ", "
+         << verdict << '\n';
+      break;
+    }
+  }
+  os << matched << " scenario(s) compared, " << regressions << " regression(s)\n";
+  return regressions;
+}
+
+std::vector<std::string> split(const std::string& s, char sep) {
+  std::vector<std::string> parts;
+  std::size_t begin = 0;
+  while (true) {
+    const auto end = s.find(sep, begin);
+    parts.push_back(s.substr(begin, end - begin));
+    if (end == std::string::npos) break;
+    begin = end + 1;
+  }
+  return parts;
+}
+
+// Parses a count with an optional K/M/G (powers of 1024) suffix.
+std::size_t parse_count(const std::string& s) {
+  std::size_t pos = 0;
+  const unsigned long long n = std::stoull(s, &pos);
+  const std::string suffix = s.substr(pos);
+  if (suffix.empty()) return n;
+  if (suffix == "K" || suffix == "k") return n << 10;
+  if (suffix == "M" || suffix == "m") return n << 20;
+  if (suffix == "G" || suffix == "g") return n << 30;
+  throw std::invalid_argument("bad count: " + s);
+}
+
+// Parses a comma-separated list of counts and inclusive ranges, e.g. "0-3,8".
+std::vector<std::size_t> parse_counts(const std::string& s) {
+  std::vector<std::size_t> values;
+  for (const auto& part : split(s, ',')) {
+    const auto dash = part.find('-');
+    if (dash == std::string::npos) {
+      values.push_back(parse_count(part));
+      continue;
+    }
+    const auto lo = parse_count(part.substr(0, dash));
+    const auto hi = parse_count(part.substr(dash + 1));
+    for (auto i = lo; i <= hi; ++i) values.push_back(i);
+  }
+  return values;
+}
+
+// Parses "LO-HI[:N]" into geometrically spaced sizes, N per doubling.
+std::vector<std::size_t> parse_sweep(const std::string& s) {
+  const auto colon = s.find(':');
+  const auto range = s.substr(0, colon);
+  const auto dash = range.find('-');
+  if (dash == std::string::npos) throw std::invalid_argument("bad sweep: " + s);
+  const auto lo = parse_count(range.substr(0, dash));
+  const auto hi = parse_count(range.substr(dash + 1));
+  const auto per_doubling = colon == std::string::npos ? 1 : parse_count(s.substr(colon + 1));
+  if (lo == 0 || hi < lo || per_doubling == 0) throw std::invalid_argument("bad sweep: " + s);
+  std::vector<std::size_t> sizes;
+  for (std::size_t i = 0;; ++i) {
+    const auto size = static_cast<std::size_t>(
+        std::llround(lo * std::pow(2.0, static_cast<double>(i) / per_doubling)));
+    if (size > hi) break;
+    if (sizes.empty() || size != sizes.back()) sizes.push_back(size);
+  }
+  return sizes;
+}
+
+void print_usage(std::ostream& os) {
+  os << "usage: heap [options]\n"
+        "  --types=LIST     element types: float, double, int32, int64, pair16\n"
+        "                   (key + payload), record32, record40, record64, or\n"
+        "                   all (float)\n"
+        "  --sizes=LIST     heap sizes, K/M/G suffixes allowed (5000)\n"
+        "  --sweep=LO-HI[:N]  sizes from LO to HI, N per doubling (1), e.g. 1K-1G\n"
+        "  --offsets=LIST   root offsets in elements, ranges allowed (0-9)\n"
+        "  --arities=LIST   heap arities; only 2 is implemented (2)\n"
+        "  --layouts=LIST   heap (size_t index), compact (uint32_t index),\n"
+        "                   aligned (cache-aligned column), aging (AgingHeap),\n"
+        "                   std-pq (std::priority_queue), std-heap\n"
+        "                   (std::make_heap and friends), pairing (pairing\n"
+        "                   heap on pooled nodes) (all)\n"
+        "  --baseline=NAME  layout to compare the others to, or none (std-pq)\n"
+        "  --ops=LIST       build, push, pop, meld (merge heaps of 64 elements\n"
+        "                   into the first, one at a time), or n-step mixes on\n"
+        "                   a built heap: hold, insert-heavy, pop-heavy,\n"
+        "                   decrease-key, dijkstra (build)\n"
+        "  --hold-model     run the hold-model benchmark instead: each layout at\n"
+        "                   --sizes, popping the minimum and pushing it back\n"
+        "                   plus a random increment; reports per-step latency\n"
+        "                   at steady state\n"
+        "  --increments=LIST  hold-model increment distributions: exponential,\n"
+        "                   uniform, bimodal, triangular (all)\n"
+        "  --stats          report each layout's memory layout instead: bytes\n"
+        "                   allocated, base alignment, root offset, depth and\n"
+        "                   sibling groups straddling cache lines, built from\n"
+        "                   the first input at --sizes and --offsets\n"
+        "  --publish-metrics=NAME  run hold steps on a heap of the first size for\n"
+        "                   --duration seconds, publishing its counters, size,\n"
+        "                   rate and sampled latencies to the shared-memory\n"
+        "                   object NAME (e.g. /heap-metrics) every 10 ms\n"
+        "  --read-metrics=NAME  print the metrics last published to NAME\n"
+        "  --model          report the analytic layout model instead, without\n"
+        "                   running anything: distinct cache lines and pages\n"
+        "                   per root-to-leaf sift-down and per build, for each\n"
+        "                   type, arity (any, here), size and offset, with the\n"
+        "                   array at --sim-base and --sim-line, --sim-page sizes\n"
+        "  --graphs=LIST    run the graph-search benchmark instead on generated\n"
+        "                   graphs of --sizes vertices: grid (road-like square\n"
+        "                   grid) or random (average degree 8), with every\n"
+        "                   layout at every offset as the queue; --trials\n"
+        "                   searches each. pairing lowers queued entries in\n"
+        "                   place, the others push improved vertices again\n"
+        "  --algorithms=LIST  graph searches: dijkstra, astar (grids only) or\n"
+        "                   prim (all)\n"
+        "  --frontends=LIST run the scaling benchmark instead: threads share one\n"
+        "                   locked (one mutex), sharded (a heap per thread) or\n"
+        "                   multiqueue (relaxed MultiQueue) front end, running\n"
+        "                   --ops (mixes without decrease-key, or\n"
+        "                   producer-consumer; hold by default) on a --sizes\n"
+        "                   prefill\n"
+        "  --placements=LIST  scaling thread pinning: none, compact (fill a\n"
+        "                   socket first) or spread (alternate sockets) (none)\n"
+        "  --duration=SEC   length of each scaling run, and of a\n"
+        "                   --publish-metrics run (0.2)\n"
+        "  --trace=FILE     benchmark the replay op: the binary operation trace\n"
+        "                   in FILE, run on an empty heap. Replaces --ops,\n"
+        "                   --inputs and --sizes\n"
+        "  --record-trace=FILE  write the first op on the first size and input\n"
+        "                   (after its build) as a trace to FILE and exit\n"
+        "  --inputs=LIST    key orders: reverse, sorted, uniform, few-distinct,\n"
+        "                   zipf, sawtooth, adversarial (reverse)\n"
+        "  --threads=LIST   threads each running their own heap, or sharing\n"
+        "                   the front end with --frontends (1)\n"
+        "  --trials=N       timed samples per configuration and thread (50)\n"
+        "  --warmup=N       most warmup runs; stops early once stable (50)\n"
+        "  --min-time=SEC   shortest timed sample; faster runs are batched (0.001)\n"
+        "  --bootstrap=N    resamples for the median's confidence interval (1000)\n"
+        "  --seed=N         seed for inputs and mixes (1)\n"
+        "  --counters       count cycles, instructions, branch misses, L1D, LLC\n"
+        "                   and dTLB misses with perf_event_open, where allowed\n"
+        "  --work           count compares, moves, sift levels and allocations\n"
+        "                   per element in one untimed run; heap and compact\n"
+        "                   layouts only. push is a repeated-Push build\n"
+        "  --latency        time every Heap operation in extra untimed runs and\n"
+        "                   report p50, p99, p99.9 and max; heap and compact\n"
+        "                   layouts only\n"
+        "  --depths         record how many levels each Push, Pop and Update sifts\n"
+        "                   in one untimed run and report the distribution; heap\n"
+        "                   and compact layouts only\n"
+        "  --depth-sample=N sample one operation in N for --depths (1)\n"
+        "  --simulate       replay each op's element accesses through a simulated\n"
+        "                   LRU cache and TLB hierarchy instead of timing it;\n"
+        "                   heap and compact layouts only, one run, one thread\n"
+        "  --sim-base=N     simulated address of the heap array (16)\n"
+        "  --sim-caches=LIST  simulated caches as BYTES/WAYS, L1 first, K/M/G\n"
+        "                   suffixes allowed (detected caches)\n"
+        "  --sim-tlbs=LIST  simulated TLBs as ENTRIES/WAYS (64/4,1536/12)\n"
+        "  --sim-line=N     simulated cache line size (detected, or 64)\n"
+        "  --sim-page=N     simulated page size (4096)\n"
+        "  --save-baseline=FILE  save the results' summaries to the JSON baseline\n"
+        "                   store FILE, keyed by CPU model, compiler and build\n"
+        "                   flags, replacing any baseline with the same key\n"
+        "  --compare=FILE   compare the results with this host's baseline in\n"
+        "                   FILE and exit with status 1 on a regression\n"
+        "  --alpha=P        significance level of Welch's t-test (0.01)\n"
+        "  --threshold=F    smallest relative slowdown of the mean that counts\n"
+        "                   as a regression (0.05)\n"
+        "  --format=FMT     text, csv or json (text)\n";
+}
+
+// Parses a comma-separated list of SIZE/WAYS pairs.
+std::vector<CacheSimConfig::Level> parse_sim_levels(const std::string& s) {
+  std::vector<CacheSimConfig::Level> levels;
+  for (const auto& part : split(s, ',')) {
+    const auto fields = split(part, '/');
+    if (fields.size() != 2) throw std::invalid_argument("expected SIZE/WAYS: " + part);
+    levels.push_back({parse_count(fields[0]), parse_count(fields[1])});
+    if (levels.back().size == 0 || levels.back().ways == 0) {
+      throw std::invalid_argument("bad cache level: " + part);
+    }
+  }
+  return levels;
+}
+
+const std::vector<std::string> kAllTypes = {"int32",  "float",    "int64",   "double",
+                                             "pair16", "record32", "record40", "record64"};
+
+BenchOptions parse_options(int argc, char** argv) {
+  BenchOptions opt;
+  opt.sim.tlbs = {{64, 4}, {1536, 12}};
+  bool sim_caches = false, sim_line = false, ops_given = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg = argv[i];
+    std::string value;
+    const auto eq = arg.find('=');
+    if (eq != std::string::npos) {
+      value = arg.substr(eq + 1);
+      arg = arg.substr(0, eq);
+    } else if (arg != "--help" && arg != "--counters" && arg != "--work" && arg != "--depths" &&
+               arg != "--latency" && arg != "--hold-model" && arg != "--stats" &&
+               arg != "--model" &&
+               arg != "--simulate" &&
+               i + 1 < argc) {
+      value = argv[++i];
+    }
+    if (arg == "--help") {
+      print_usage(std::cout);
+      std::exit(0);
+    } else if (arg == "--types") {
+      opt.types = value == "all" ? kAllTypes : split(value, ',');
+    } else if (arg == "--sizes") {
+      opt.sizes = parse_counts(value);
+    } else if (arg == "--sweep") {
+      opt.sizes = parse_sweep(value);
+    } else if (arg == "--offsets") {
+      opt.offsets = parse_counts(value);
+    } else if (arg == "--arities") {
+      opt.arities = parse_counts(value);
+    } else if (arg == "--layouts") {
+      opt.layouts = split(value, ',');
+    } else if (arg == "--ops") {
+      opt.ops = split(value, ',');
+      ops_given = true;
+    } else if (arg == "--counters") {
+      opt.counters = true;
+    } else if (arg == "--work") {
+      opt.work = true;
+    } else if (arg == "--depths") {
+      opt.depths = true;
+    } else if (arg == "--depth-sample") {
+      opt.depth_period = static_cast<std::uint32_t>(std::max<std::size_t>(parse_count(value), 1));
+    } else if (arg == "--latency") {
+      opt.latency = true;
+    } else if (arg == "--simulate") {
+      opt.simulate = true;
+    } else if (arg == "--sim-base") {
+      opt.sim_base = parse_count(value);
+    } else if (arg == "--sim-caches") {
+      opt.sim.caches = parse_sim_levels(value);
+      sim_caches = true;
+    } else if (arg == "--sim-tlbs") {
+      opt.sim.tlbs = parse_sim_levels(value);
+    } else if (arg == "--sim-line") {
+      opt.sim.line = parse_count(value);
+      sim_line = true;
+    } else if (arg == "--sim-page") {
+      opt.sim.page = parse_count(value);
+    } else if (arg == "--baseline") {
+      opt.baseline = value;
+    } else if (arg == "--hold-model") {
+      opt.hold_model = true;
+    } else if (arg == "--stats") {
+      opt.stats = true;
+    } else if (arg == "--model") {
+      opt.model = true;
+    } else if (arg == "--publish-metrics") {
+      opt.publish_metrics = value;
+    } else if (arg == "--read-metrics") {
+      opt.read_metrics = value;
+    } else if (arg == "--increments") {
+      opt.increments = split(value, ',');
+    } else if (arg == "--graphs") {
+      opt.graphs = split(value, ',');
+    } else if (arg == "--algorithms") {
+      opt.algorithms = split(value, ',');
+      for (const auto& a : opt.algorithms) {
+        if (a != "dijkstra" && a != "astar" && a != "prim") {
+          throw std::invalid_argument("unknown graph algorithm: " + a);
+        }
+      }
+    } else if (arg == "--frontends") {
+      opt.frontends = split(value, ',');
+    } else if (arg == "--placements") {
+      opt.placements = split(value, ',');
+    } else if (arg == "--duration") {
+      opt.duration = std::stod(value);
+    } else if (arg == "--trace") {
+      opt.trace = load_trace(value);
+      if (opt.trace.empty()) throw std::invalid_argument("empty trace: " + value);
+    } else if (arg == "--record-trace") {
+      opt.record_trace = value;
+    } else if (arg == "--save-baseline") {
+      opt.save_baseline = value;
+    } else if (arg == "--compare") {
+      opt.compare = value;
+    } else if (arg == "--alpha") {
+      opt.alpha = std::stod(value);
+    } else if (arg == "--threshold") {
+      opt.threshold = std::stod(value);
+    } else if (arg == "--inputs") {
+      opt.inputs = split(value, ',');
+    } else if (arg == "--seed") {
+      opt.seed = std::stoull(value);
+    } else if (arg == "--threads") {
+      opt.threads = parse_counts(value);
+    } else if (arg == "--trials") {
+      opt.trials = parse_count(value);
+    } else if (arg == "--warmup") {
+      opt.warmup = parse_count(value);
+    } else if (arg == "--min-time") {
+      opt.min_time = std::stod(value);
+    } else if (arg == "--bootstrap") {
+      opt.bootstrap = parse_count(value);
+    } else if (arg == "--format") {
+      opt.format = value;
+    } else {
+      throw std::invalid_argument("unknown option: " + arg);
+    }
+  }
+  for (const auto arity : opt.arities) {
+    if (opt.model ? arity < 2 : arity != 2) {
+      throw std::invalid_argument("only binary heaps (arity 2) are implemented");
+    }
+  }
+  for (const auto threads : opt.threads) {
+    if (threads == 0) throw std::invalid_argument("thread counts must be positive");
+  }
+  if (opt.trials == 0 || opt.warmup == 0 || opt.offsets.empty()) {
+    throw std::invalid_argument("need at least one trial, warmup run and offset");
+  }
+  if (opt.baseline == "none") {
+    opt.baseline.clear();
+  } else if (std::find(opt.layouts.begin(), opt.layouts.end(), opt.baseline) ==
+             opt.layouts.end()) {
+    opt.layouts.push_back(opt.baseline);
+  }
+  if (!opt.frontends.empty()) {
+    if (!ops_given) opt.ops = {"hold"};
+    for (const auto& op : opt.ops) {
+      if (op != "producer-consumer" && (!is_mix(op) || op == "replay")) {
+        throw std::invalid_argument("the scaling benchmark runs mixes, not " + op);
+      }
+    }
+  }
+  if (!opt.trace.empty()) {
+    opt.ops = {"replay"};
+    opt.inputs = {"trace"};
+    opt.sizes = {opt.trace.size()};
+  } else if (std::find(opt.ops.begin(), opt.ops.end(), "replay") != opt.ops.end() ||
+             std::find(opt.inputs.begin(), opt.inputs.end(), "trace") != opt.inputs.end()) {
+    throw std::invalid_argument("replay needs a --trace");
+  }
+  if (opt.simulate || opt.model) {
+    if (!sim_line && !opt.caches.empty() && opt.caches.front().line) {
+      opt.sim.line = opt.caches.front().line;
+    }
+    if (opt.sim.line == 0 || opt.sim.page == 0) {
+      throw std::invalid_argument("simulated line and page sizes must be positive");
+    }
+  }
+  if (std::find(opt.ops.begin(), opt.ops.end(), "meld") != opt.ops.end() &&
+      (opt.work || opt.latency || opt.depths || opt.simulate)) {
+    throw std::invalid_argument(
+        "meld runs on many heaps; --work, --latency, --depths and --simulate follow one");
+  }
+  if (opt.simulate) {
+    // Default to the host's data caches, assuming 8 ways where unknown.
+    if (!sim_caches) {
+      for (const auto& c : opt.caches) opt.sim.caches.push_back({c.bytes, c.ways ? c.ways : 8});
+    }
+    // One deterministic run per configuration; nothing to compare against.
+    opt.threads = {1};
+    opt.baseline.clear();
+  }
+  if ((!opt.save_baseline.empty() || !opt.compare.empty()) &&
+      (opt.simulate || opt.hold_model || opt.stats || opt.model || !opt.frontends.empty() ||
+       !opt.graphs.empty() ||
+       !opt.record_trace.empty() || !opt.publish_metrics.empty() ||
+       !opt.read_metrics.empty())) {
+    throw std::invalid_argument("baselines hold timed benchmark results only");
+  }
+  if (opt.counters && !PerfCounters().any_available()) {
+    std::cerr << "heap: no hardware counters available (see perf_event_paranoid);"
+                 " reporting times only\n";
+  }
+  if (opt.format != "text" && opt.format != "csv" && opt.format != "json") {
+    throw std::invalid_argument("unknown format: " + opt.format);
+  }
+  return opt;
+}
+
+int main(int argc, char** argv) {
+  BenchOptions opt;
+  std::vector<BenchResult> results;
+  try {
+    opt = parse_options(argc, argv);
+    if (!opt.record_trace.empty()) {
+      record_trace(opt);
+      return 0;
+    }
+    if (!opt.read_metrics.empty()) {
+      report_metrics(MetricsReader(opt.read_metrics).Read(), opt.format, std::cout);
+      return 0;
+    }
+    if (!opt.publish_metrics.empty()) {
+      report_metrics(publish_metrics(opt), opt.format, std::cout);
+      return 0;
+    }
+    if (opt.model) {
+      std::vector<ModelResult> model;
+      run_model(opt, model);
+      report_model(model, opt.format, std::cout);
+      return 0;
+    }
+    if (opt.stats) {
+      std::vector<StatsResult> stats;
+      run_stats(opt, stats);
+      report_stats(stats, opt.format, std::cout);
+      return 0;
+    }
+    if (opt.hold_model) {
+      std::vector<HoldResult> hold;
+      run_hold(opt, hold);
+      report_hold(hold, opt.format, std::cout);
+      return 0;
+    }
+    if (!opt.graphs.empty()) {
+      std::vector<GraphResult> graphs;
+      run_graphs(opt, graphs);
+      report_graphs(graphs, opt.format, std::cout);
+      return 0;
+    }
+    if (!opt.frontends.empty()) {
+      std::vector<ScalingResult> scaling;
+      run_scaling(opt, scaling);
+      report_scaling(scaling, opt.format, std::cout);
+      return 0;
+    }
+    run_benchmarks(opt, results);
+    if (!opt.save_baseline.empty()) save_baseline(results, opt.save_baseline);
+  } catch (const std::exception& e) {
+    std::cerr << "heap: " << e.what() << '\n';
+    print_usage(std::cerr);
+    return 2;
+  }
+
+  if (opt.format == "csv") {
+    report_csv(results, opt, std::cout);
+  } else if (opt.format == "json") {
+    report_json(results, opt, std::cout);
+  } else if (opt.simulate) {
+    report_simulation(results, opt, std::cout);
+  } else {
+    report_text(results, opt, std::cout);
+    if (opt.sizes.size() > 1) report_sweep(results, opt, std::cout);
+    if (opt.types.size() > 1) report_matrix(results, opt, std::cout);
+    if (!opt.baseline.empty()) report_comparison(results, opt.baseline, std::cout);
+  }
+  if (!opt.compare.empty()) {
+    try {
+      // With machine-readable output on stdout the comparison goes to stderr.
+      if (compare_baseline(results, opt, opt.format == "text" ? std::cout : std::cerr) > 0) {
+        return 1;
+      }
+    } catch (const std::exception& e) {
+      std::cerr << "heap: " << e.what() << '\n';
+      return 2;
+    }
+  }
   return 0;
 }